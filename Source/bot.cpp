@@ -6,10 +6,18 @@
 #endif
 
 #include <time.h>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 #include "bot.h"
 #include "chess.h"
 
+// Shared by every bot without a BEGIN_HASH section
+int bot::s_defaultHashSize = TT_DEFAULT_MB;
+unsigned long long bot::s_defaultSeed = DEFAULT_SEED;
+int bot::s_botCount = 0;
+
 // Sets the defaults for each piece
 bot::piece::piece()
 {
@@ -32,12 +40,21 @@ bot::piece::piece()
  * Returns:     None
  * Description: This is the default constructor for the bot which merely
  *		loads the default values for the bot.
- * Invokes:     None
- * Note:        None
+ * Invokes:     loadDefault(), clearHeuristics()
+ * Note:        Each bot gets the next number, which sets its random numbers
+ *		apart from the other bots'.  Copies (the helper threads) keep
+ *		the number of the bot they were copied from.
  ***************************************************************************/
 bot::bot()
 {
+	m_botNumber = s_botCount++;
+	m_table = std::make_shared<TransTable>();
+	m_pAbort = 0;
+	m_pPonderHit = 0;
+	m_orderSalt = 0;
+
 	loadDefault();
+	clearHeuristics();
 }
 
 /****************************************************************************
@@ -61,8 +78,9 @@ bot::~bot()
  * Output:      None
  * Returns:     None
  * Description: This function is simplistic in that all it does is load the
- *		most likely defaults that a bot would use.
- * Invokes:     None
+ *		most likely defaults that a bot would use.  The random numbers
+ *		start over from the default seed.
+ * Invokes:     nextRandom()
  * Note:        This will override any bot values you currently have.
  *		Use at your own risk.
  ***************************************************************************/
@@ -108,11 +126,56 @@ void bot::loadDefault()
 	// Default for a bot is no randomness
 	m_random = 5;
 
+	// Start the random numbers over, so a bot loaded with the same seed
+	// plays the same way.  The bot's number is mixed in (splitmix64) so
+	// each bot has its own sequence.
+	m_rng = s_defaultSeed + (unsigned long long)(m_botNumber + 1) * 0x9E3779B97F4A7C15ULL;
+	m_rng = (m_rng ^ (m_rng >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	m_rng = (m_rng ^ (m_rng >> 27)) * 0x94D049BB133111EBULL;
+	m_rng ^= m_rng >> 31;
+
+	if (m_rng == 0)
+		m_rng = 1;
+
+	m_noiseKey = nextRandom();
+	m_noiseKey = (m_noiseKey << 32) | nextRandom();
+
 	// Default is the bot wants less pieces
 	m_morePieces = false;
 
 	// Start the time at 0
 	m_totalTime = 0;
+
+	// Use the default transposition table size
+	m_hashSize = 0;
+
+	// Selective search on, with the usual settings
+	m_nullMove = true;
+	m_nullReduction = 2;
+	m_nullVerify = 1;
+	m_noNull = false;
+	m_lmr = true;
+	m_lmrDepth = 3;
+	m_lmrMoves = 3;
+
+	// Search on one thread, and only on the bot's own time
+	m_threads = 1;
+	m_ponder = false;
+	m_ponderMove = Move();
+
+	// No time control - the threshold table alone sets the depth
+	m_moveTime = 0;
+	m_baseTime = 0;
+	m_increment = 0;
+	m_depthCap = true;
+	m_clock = 0;
+	m_softLimit = 0;
+	m_hardLimit = 0;
+	m_stopSearch = false;
+	m_nodes = 0;
+	m_printStats = false;
+
+	setDeltaMargin();
 }
 
 /****************************************************************************
@@ -124,7 +187,7 @@ void bot::loadDefault()
  *              It reads the file being careful to omit comments / spaces
  *              and to keep track of what state it is currently in.
  *              Most of the actual data parsing is done by loadData.
- * Invokes:     loadData, loadDefault
+ * Invokes:     loadData, loadDefault, setDeltaMargin, newGame
  * Note:        The .bot extension is just a convention.  Any extension may
  *		be used provided it is in text format and has the appropriate
  *		syntax.  For more information see one of the other bot files.
@@ -178,6 +241,15 @@ void bot::loadAI(std::string s)
 				else if(s == "BEGIN_RANDOM")
 					currState = "BEGIN_RANDOM";
 
+				else if(s == "BEGIN_HASH")
+					currState = "BEGIN_HASH";
+
+				else if(s == "BEGIN_TIME")
+					currState = "BEGIN_TIME";
+
+				else if(s == "BEGIN_SEARCH")
+					currState = "BEGIN_SEARCH";
+
 				else if(s == "BEGIN_BOARD_EMPHASIS")
 					currState = "BEGIN_BOARD_EMPHASIS";
 
@@ -211,6 +283,11 @@ void bot::loadAI(std::string s)
 		in.close();
 	}
 
+	// Scores from the old heuristics mean nothing to the new ones, and the
+	// clock starts over with the new time control
+	setDeltaMargin();
+	newGame();
+
 	cout << "Loaded: " << s << endl;
 }
 
@@ -222,7 +299,7 @@ void bot::loadAI(std::string s)
  * Description: This function loads the appropriate data given the state.
  *		The stringstream ss contains the data and is given in that
  *		format for convient data parsing.
- * Invokes:     None
+ * Invokes:     nextRandom()
  * Note:        None
  ***************************************************************************/
 void bot::loadData(std::istringstream &ss, std::string &state)
@@ -250,7 +327,7 @@ void bot::loadData(std::istringstream &ss, std::string &state)
 		ss >> numPly;
 
 		if(numPly < 0)
-			numPly = (rand() % (-numPly)) + 1;
+			numPly = (nextRandom() % (-numPly)) + 1;
 
 		m_threshold[numTotalPieces] = numPly;
 	}
@@ -266,6 +343,67 @@ void bot::loadData(std::istringstream &ss, std::string &state)
 		m_random = random;
 	}
 
+	else if(state == "BEGIN_HASH")
+	{
+		int megabytes = 0;
+
+		// Read in a single value - the transposition table size in MB
+		if((ss >> megabytes) && megabytes > 0)
+			m_hashSize = megabytes;
+	}
+
+	else if(state == "BEGIN_TIME")
+	{
+		std::string key;
+		int value = 0;
+
+		// Read in a name and a value - times are in milliseconds
+		ss >> key >> value;
+
+		if(value < 0)
+			value = 0;
+
+		if(key == "move_time")
+			m_moveTime = value;
+		else if(key == "base_time")
+			m_baseTime = value;
+		else if(key == "increment")
+			m_increment = value;
+		else if(key == "depth_cap")
+			m_depthCap = (value != 0);
+	}
+
+	else if(state == "BEGIN_SEARCH")
+	{
+		std::string key;
+		int value = 0;
+
+		// Read in a name and a value
+		ss >> key >> value;
+
+		if(value < 0)
+			value = 0;
+
+		if(key == "null_move")
+			m_nullMove = (value != 0);
+		else if(key == "null_reduction" && value > 0)
+			m_nullReduction = value;
+		else if(key == "null_verify")
+			m_nullVerify = value;
+		else if(key == "lmr")
+			m_lmr = (value != 0);
+		else if(key == "lmr_depth" && value > 0)
+			m_lmrDepth = value;
+		else if(key == "lmr_moves" && value > 0)
+			m_lmrMoves = value;
+		else if(key == "threads" && value > 0)
+			m_threads = (value > MAX_THREADS ? MAX_THREADS : value);
+		else if(key == "ponder")
+			m_ponder = (value != 0);
+		else if(key == "stats")
+			m_printStats = (value != 0);
+	}
+
 	else if(state == "BEGIN_BOARD_EMPHASIS")
 	{
 		// Read in a single value
@@ -454,6 +592,8 @@ void bot::loadData(std::istringstream &ss, std::string &state)
  *				player.
  * Invokes:     GetNumPieces() from the chess class
  *				GetBoard() from the chess class
+ *				GetOccupancy() from the chess class
+ *				GetHash() from the chess class
  * Note:        Rather than summing differently for each player, we just sum up from
  *				white's perspective, then if player == black, just take the opposite.
  *				This takes advantage of the zero-sum property of the chess board.
@@ -464,102 +604,103 @@ int bot::evaluate(Chess *pChess, int player)
 	int value = 0;
 	int piece_value = 0;
 
-	// Check every location on the board
-	for (int x = 0; x < 8; x++)
-	{
-		for (int y = 0; y < 8; y++)
-		{
-			// Find out what type of piece is at this location
-			int type = pChess->GetBoard(x, y);
+	// Only visit the squares that actually hold a piece
+	Bitboard pieces = pChess->GetOccupancy(PLAYER_WHITE) | pChess->GetOccupancy(PLAYER_BLACK);
 
-			// If it's empty, move on to the next spot
-			if (type == EMPTY)
-				continue;
+	while (pieces)
+	{
+		int s = PopLowestSquare(pieces);
+		int x = SQUARE_X(s);
+		int y = SQUARE_Y(s);
 
-			// Add the appropriate heuristic value given the piece type
-			if (type == PAWN_WHITE)
-			{
-				piece_value = m_pawn.m_weight;
-				piece_value += m_pawn.m_bValue[x][y];
-			}
+		// Find out what type of piece is at this location
+		int type = pChess->GetBoard(x, y);
 
-			else if (type == PAWN_BLACK)
-			{
-				piece_value = m_pawn.m_weight;
-				piece_value += m_pawn.m_bValue[7-x][7-y];
-			}
+		// Add the appropriate heuristic value given the piece type
+		if (type == PAWN_WHITE)
+		{
+			piece_value = m_pawn.m_weight;
+			piece_value += m_pawn.m_bValue[x][y];
+		}
 
-			else if (type == ROOK_WHITE)
-			{
-				piece_value = m_rook.m_weight;
-				piece_value += m_rook.m_bValue[x][y];
-			}
+		else if (type == PAWN_BLACK)
+		{
+			piece_value = m_pawn.m_weight;
+			piece_value += m_pawn.m_bValue[7-x][7-y];
+		}
 
-			else if (type == ROOK_BLACK)
-			{
-				piece_value = m_rook.m_weight;
-				piece_value += m_rook.m_bValue[7-x][7-y];
-			}
+		else if (type == ROOK_WHITE)
+		{
+			piece_value = m_rook.m_weight;
+			piece_value += m_rook.m_bValue[x][y];
+		}
 
-			else if (type == KNIGHT_WHITE)
-			{
-				piece_value = m_knight.m_weight;
-				piece_value += m_knight.m_bValue[x][y];
-			}
+		else if (type == ROOK_BLACK)
+		{
+			piece_value = m_rook.m_weight;
+			piece_value += m_rook.m_bValue[7-x][7-y];
+		}
 
-			else if (type == KNIGHT_BLACK)
-			{
-				piece_value = m_knight.m_weight;
-				piece_value += m_knight.m_bValue[7-x][7-y];
-			}
+		else if (type == KNIGHT_WHITE)
+		{
+			piece_value = m_knight.m_weight;
+			piece_value += m_knight.m_bValue[x][y];
+		}
 
-			else if (type == BISHOP_WHITE)
-			{
-				piece_value = m_bishop.m_weight;
-				piece_value += m_bishop.m_bValue[x][y];
-			}
+		else if (type == KNIGHT_BLACK)
+		{
+			piece_value = m_knight.m_weight;
+			piece_value += m_knight.m_bValue[7-x][7-y];
+		}
 
-			else if (type == BISHOP_BLACK)
-			{
-				piece_value = m_bishop.m_weight;
-				piece_value += m_bishop.m_bValue[7-x][7-y];
-			}
+		else if (type == BISHOP_WHITE)
+		{
+			piece_value = m_bishop.m_weight;
+			piece_value += m_bishop.m_bValue[x][y];
+		}
 
-			else if (type == QUEEN_WHITE)
-			{
-				piece_value = m_queen.m_weight;
-				piece_value += m_queen.m_bValue[x][y];
-			}
+		else if (type == BISHOP_BLACK)
+		{
+			piece_value = m_bishop.m_weight;
+			piece_value += m_bishop.m_bValue[7-x][7-y];
+		}
 
-			else if (type == QUEEN_BLACK)
-			{
-				piece_value = m_queen.m_weight;
-				piece_value += m_queen.m_bValue[7-x][7-y];
-			}
+		else if (type == QUEEN_WHITE)
+		{
+			piece_value = m_queen.m_weight;
+			piece_value += m_queen.m_bValue[x][y];
+		}
 
-			else if (type == KING_WHITE)
-			{
-				piece_value = m_king.m_weight;
-				piece_value += m_king.m_bValue[x][y];
-			}
+		else if (type == QUEEN_BLACK)
+		{
+			piece_value = m_queen.m_weight;
+			piece_value += m_queen.m_bValue[7-x][7-y];
+		}
 
-			else if (type == KING_BLACK)
-			{
-				piece_value = m_king.m_weight;
-				piece_value += m_king.m_bValue[7-x][7-y];
-			}
+		else if (type == KING_WHITE)
+		{
+			piece_value = m_king.m_weight;
+			piece_value += m_king.m_bValue[x][y];
+		}
 
-			// Now add the piece value for white pieces, subtract it for black
-			if (pChess->WhitePiece(type))
-				value += piece_value;
-			else
-				value -= piece_value;
+		else if (type == KING_BLACK)
+		{
+			piece_value = m_king.m_weight;
+			piece_value += m_king.m_bValue[7-x][7-y];
 		}
+
+		// Now add the piece value for white pieces, subtract it for black
+		if (pChess->WhitePiece(type))
+			value += piece_value;
+		else
+			value -= piece_value;
 	}
 
-	// Once the total value is determined, account for the randomness of the bot
+	// Once the total value is determined, account for the randomness of the bot.
+	// Each position gets its own amount, from its hash key, so it scores the
+	// same every time it is reached - in the table, and on every thread.
 	if (m_random > 0)
-		value += rand() % m_random;
+		value += (int)((((pChess->GetHash() ^ m_noiseKey) * 0x9E3779B97F4A7C15ULL) >> 32) % m_random);
 
 	// If the bot doesn't like to have more pieces on the board, subtract a small value
 	// depending on the total number
@@ -578,14 +719,15 @@ int bot::evaluate(Chess *pChess, int player)
  * Name:        negaMax
  * Input:       pChess - pointer to an instance of the chess class,
  *				depth - how much deeper to search (in plies)
+ *				ply - how many moves from the top of the search
  *				player - the current player in the search (ie min or max)
  *				alpha - the lower bound for our alpha beta pruning
  *				beta - the upper bound for our alpha beta pruning
  * Output:      None
- * Returns:     A Move structure that contains the best move for that player to make
- *				For most levels of iteration we only care about the value of this move,
- *				but at the top level (ie when depth equals the search depth of our bot)
- *				this move represents the move that our bot will make.
+ * Returns:     The value of the best move for that player to make.
+ *				At the top level (ie when depth equals the search depth of our bot)
+ *				the move itself is stored in m_bestMove, it is the move that our bot
+ *				will make.
  * Description: This search is what drives all of our bots.  Each bot script will have different
  *				heuristic values, but this search will control all of them.  "Nega Max" is a variant
  *				of min max, but it saves time and complication by encapsulating both min's turn and
@@ -594,123 +736,551 @@ int bot::evaluate(Chess *pChess, int player)
  *				of a given move is equal to the opposite of the opponents best move in that scenario.  Say, for
  *				example, we generate all the moves for white.  Now we look at the first possible moves, and calculate
  *				black's best reply (recursively).  The value of this first move is set to the value of black's best
- *				reply, but negative.
+ *				reply, but negative.  Values are kept in the search itself rather than in the (packed) moves.
  * Invokes:     negaMax() (recursively)
- *				evaluate()
+ *				checkTime()
+ *				quiesce()
  *				GenerateMoves() - from the chess class
- *				orderMoves()
- *				GetState() - from the chess class
+ *				scoreMoves()
+ *				pickMove()
  *				InCheck() - from the chess class
- *				GetRecentMove() - from the chess class
+ *				Repetitions() - from the chess class
+ *				GetHalfmoveClock() - from the chess class
+ *				GetHash() - from the chess class
+ *				Probe(), Store() - from the transposition table
+ *				bigPieces()
  *				SimulateMove() - from the chess class
  *				UnSimulateMove() - from the chess class
+ *				SimulateNullMove() - from the chess class
+ *				UnSimulateNullMove() - from the chess class
  * Note:        alpha should be set to a very low value to start the search (in theory, negative infinity),
  *				and beta should be set likewise to a very high value.  Since we can't use infinity we use
- *				-10*CHECKMATE and +10*CHECKMATE as bounds.
+ *				-SEARCH_INFINITY and SEARCH_INFINITY as bounds.
+ *				After the first move, each move is searched with an empty window
+ *				just to show it is no better (principal variation search).
+ *				Null move pruning and late move reductions cut the depth in
+ *				places, so depth and ply don't always add up to the search depth.
+ *				Once m_stopSearch is set every call returns 0 straight away, and
+ *				nothing more is stored or chosen - the caller throws the result out.
  ***************************************************************************/
-Move bot::negaMax(Chess *pChess, int depth, int player, int alpha, int beta)
+int bot::negaMax(Chess *pChess, int depth, int ply, int player, int alpha, int beta)
 {
-	// Stores our best move
-	Move best;
+	if (checkTime())
+		return 0;
 
-	// At depth 0, we simply evaluate the board and return
-	if (depth == 0)
+	// Below the top level, a position that repeats one already played or
+	// searched, or that hits the fifty move rule, is scored as a draw
+	if (ply > 0 && (pChess->Repetitions() > 0 || pChess->GetHalfmoveClock() >= 100))
+		return 0;
+
+	// At depth 0, play out the captures and evaluate once things are quiet
+	if (depth <= 0 || ply >= MAX_PLY - 1)
 	{
-		best.value = evaluate(pChess, player);
 		//Used for Testing purposes - prints out evaluated value of board
-		//cout << "Board Value = " << best.value << endl;
-		return best;
+		//cout << "Board Value = " << evaluate(pChess, player) << endl;
+		return quiesce(pChess, player, alpha, beta, ply);
+	}
+
+	// See if this position has been searched before.  If it was searched at
+	// least as deep, the stored score may settle it without searching again
+	// (except at the top, where we need a move).  Either way its best move
+	// is the one to try first.
+	HashKey key = pChess->GetHash();
+	int alpha_start = alpha;
+	Move hash_move;
+	TTEntry entry;
+
+	m_ttProbes++;
+
+	if (m_table->Probe(key, entry))
+	{
+		m_ttHits++;
+		hash_move = entry.move;
+
+		if (ply > 0 && entry.depth >= depth)
+		{
+			int bound = entry.flags & 3;
+
+			if (bound == TT_EXACT)
+				return entry.score;
+
+			if (bound == TT_LOWER && entry.score >= beta)
+				return entry.score;
+
+			if (bound == TT_UPPER && entry.score <= alpha)
+				return entry.score;
+		}
+	}
+
+	bool in_check = pChess->InCheck(player);
+	bool pv_node = (beta - alpha > 1);
+
+	// Null move pruning - let the opponent move twice in a row, with a
+	// shallower search.  If we are still above beta the position is good
+	// enough that a real move is bound to be too.  Passing is never better
+	// than moving except in zugzwang, so it is only tried with some pieces
+	// besides pawns, not in check, not twice in a row, and in the endgame
+	// a cutoff is checked by searching this position for real.
+	if (m_nullMove && !pv_node && ply > 0 && !in_check && !m_noNull && depth > m_nullReduction &&
+		!(m_line[ply - 1] == Move()) && bigPieces(pChess, player) > 0 &&
+		evaluate(pChess, player) >= beta)
+	{
+		int reduction = m_nullReduction + (depth > 6 ? 1 : 0);
+
+		pChess->SimulateNullMove();
+		m_line[ply] = Move();
+
+		int value = -negaMax(pChess, depth - 1 - reduction, ply + 1, other(player), -beta, -beta + 1);
+
+		pChess->UnSimulateNullMove();
+
+		if (m_stopSearch)
+			return 0;
+
+		if (value >= beta)
+		{
+			// A mate found after passing isn't real
+			if (value >= CHECKMATE)
+				value = beta;
+
+			if (bigPieces(pChess, player) > m_nullVerify)
+				return value;
+
+			m_noNull = true;
+			int verify = negaMax(pChess, depth - reduction, ply, player, beta - 1, beta);
+			m_noNull = false;
+
+			if (m_stopSearch)
+				return 0;
+
+			if (verify >= beta)
+				return value;
+		}
 	}
 
 	// Holds the list of possible moves
-	Move move_list[75];
-	// Holds the opponents best reply
-	Move reply;
+	Move move_list[MAX_MOVES];
 
 	// Generate the list of moves
 	int num_moves = pChess->GenerateMoves(move_list, player);
 
-	// Order the moves with captured moves first
+	// With no legal moves the game is over - checkmate is as bad as it gets,
+	// stalemate is a draw
+	if (num_moves == 0)
+	{
+		if (in_check)
+			return -depth * CHECKMATE;
+		else
+			return 0;
+	}
+
+	// At the top, the best move of the last iteration goes first even if
+	// its table entry has been replaced
+	if (ply == 0 && !(m_bestMove == Move()))
+		hash_move = m_bestMove;
+
+	// Score the moves so the ones most likely to cause a cutoff come first
 	// This makes it more likely that we can prune off large portions of the search
-	orderMoves(move_list, num_moves);
+	int scores[MAX_MOVES];
+
+	scoreMoves(pChess, move_list, scores, num_moves, hash_move, ply);
 
 	// Start with the best move equal to the first move
-	best = move_list[0];
-	best.value = -depth * CHECKMATE;
+	// Scores are kept here in the search rather than in the moves themselves
+	Move best;
+	int best_value = -depth * CHECKMATE;
 
-	// Loop through all the possible moves
+	// Loop through all the possible moves, best scored first
 	for (int i = 0; i < num_moves; i++)
 	{
-		// Can't allow a castle out of check (illegal)
-		if (move_list[i].castle && pChess->GetState() == STATE_CHECK && depth == m_searchDepth) 
-			continue;
+		Move m = pickMove(move_list, scores, num_moves, i);
 
-		// Make the move
-		pChess->SimulateMove(&move_list[i]);
+		if (i == 0)
+			best = m;
 
-		// If we are capturing a king, there's no need to search further
-		if (move_list[i].captured == KING_WHITE || move_list[i].captured == KING_BLACK)
-			move_list[i].value = depth * m_king.m_weight;
-	
-		// A normal case, do a recursive call for the opponent
+		bool quiet = (pChess->GetCaptured(m) == EMPTY && !m.Promotion());
+
+		// Make the move
+		pChess->SimulateMove(&m);
+		m_line[ply] = m;
+
+		// Do a recursive call for the opponent
+		// We have to swap and take the opposite of alpha and beta because we are now evaluating
+		// from the other player's perspective
+		// Also decrement the depth for the recursive call
+		// Our new move's value is the opposite of the opponent's reply
+		// Once the first move has been searched the rest are expected to be
+		// worse, which a search with an empty window (alpha, alpha + 1) can
+		// show more cheaply.  Only if one turns out better is it searched
+		// again with the full window for its real value.
+		int value;
+
+		if (i == 0)
+			value = -negaMax(pChess, depth - 1, ply + 1, other(player), -beta, -alpha);
 		else
 		{
-			// We have to swap and take the opposite of alpha and beta because we are now evaluating
-			// from the other player's perspective
-			// Also decrement the depth for the recursive call
-			reply = negaMax(pChess, depth - 1, other(player), -beta, -alpha);
-			// Our new move's value is the opposite of the opponent's reply
-			move_list[i].value = -reply.value;
-		}
+			// Late move reductions - quiet moves this far down the list
+			// rarely turn out best, so search them a ply or two shallower,
+			// and again at full depth only if one beats alpha.  Moves that
+			// give check, or that got out of one, are left alone, as are
+			// the killers and countermove.
+			int reduction = 0;
+
+			if (m_lmr && quiet && !in_check && depth >= m_lmrDepth && i >= m_lmrMoves &&
+				scores[i] < MOVE_SCORE_KILLER - 2 && !pChess->InCheck(other(player)))
+			{
+				reduction = 1;
 
-		// Reset alpha if necessary
-		if (move_list[i].value > alpha)
-			alpha = move_list[i].value;
+				if (!pv_node && i >= 3 * m_lmrMoves)
+					reduction = 2;
 
-		// If it looks like we've found a new best move, do a few additional checks
-		if (move_list[i].value > best.value)
-		{
-			// At the top level of the search we want to control a couple of factors
-			if (depth == m_searchDepth)
-			{
-				// Definitely don't want to move into check
-				if (pChess->InCheck(player))
-					move_list[i].value = -depth * CHECKMATE;
-				
-				// A stalemate is undesirable so we check the last few moves and
-				// discourage repetition
-				Move x = pChess->GetRecentMove(3);
-				Move y = pChess->GetRecentMove(7);
-
-				if (move_list[i] == x && move_list[i] == y)
-					move_list[i].value -= m_rook.m_weight;
-
-				else if (move_list[i] == x || move_list[i] == y)
-					move_list[i].value -= m_pawn.m_weight;
+				if (reduction > depth - 1)
+					reduction = depth - 1;
 			}
+
+			value = -negaMax(pChess, depth - 1 - reduction, ply + 1, other(player), -alpha - 1, -alpha);
+
+			if (reduction > 0 && value > alpha && !m_stopSearch)
+				value = -negaMax(pChess, depth - 1, ply + 1, other(player), -alpha - 1, -alpha);
+
+			if (value > alpha && value < beta && !m_stopSearch)
+				value = -negaMax(pChess, depth - 1, ply + 1, other(player), -beta, -alpha);
 		}
 
+		// Reset alpha if necessary
+		if (value > alpha)
+			alpha = value;
+
 		//Used for Printing out the Board for Testing purposes
 		//Used in printing out all legal moves when using the onePly.bot
 		//printBoard(pChess);
 
 		// Undo the move
-		pChess->UnSimulateMove(&move_list[i]);
+		pChess->UnSimulateMove(&m);
+
+		// Out of time, the value can't be trusted
+		if (m_stopSearch)
+			return 0;
 
 		// If we have a new best move, make sure we update accordingly
-		if (move_list[i].value > best.value)
-			best = move_list[i];
+		if (value > best_value)
+		{
+			best = m;
+			best_value = value;
+		}
+
+		// If our best value is bigger than beta we can break early, and
+		// remember the move if it is one the ordering would put late
+		if (best_value >= beta)
+		{
+			m_cutoffs++;
+
+			if (i == 0)
+				m_firstCutoffs++;
 
-		// If our best value is bigger than beta we can break early
-		if (best.value >= beta)
-			return best;
+			if (quiet)
+				quietCutoff(pChess, m, player, depth, ply);
+
+			break;
+		}
 	}
 	
 	//Used for Testing Purposes - prints out the best value chosen
-	//cout << "Best Value Chosen: " << -best.value << endl;
+	//cout << "Best Value Chosen: " << -best_value << endl;
 
-	// Return the best move
-	return best;
+	// At the top level, this is the move the bot will make - unless every
+	// move failed low, which says nothing about which of them is best
+	if (ply == 0 && (best_value > alpha_start || m_bestMove == Move()))
+		m_bestMove = best;
+
+	// Remember what we found, and how sure of it we are - if nothing beat
+	// alpha the real value may be lower, if we cut off it may be higher
+	int bound = TT_EXACT;
+
+	if (best_value <= alpha_start)
+		bound = TT_UPPER;
+	else if (best_value >= beta)
+		bound = TT_LOWER;
+
+	m_table->Store(key, depth, bound, best_value, best);
+
+	// Return the value of the best move
+	return best_value;
+}
+
+/****************************************************************************
+ * Name:        quiesce
+ * Input:       pChess - pointer to an instance of the chess class,
+ *				player - the current player in the search
+ *				alpha - the lower bound for our alpha beta pruning
+ *				beta - the upper bound for our alpha beta pruning
+ *				ply - how many moves from the top of the search
+ * Output:      None
+ * Returns:     The value of the position once the captures have played out
+ * Description: Stopping the search in the middle of an exchange scores a
+ *				position where a piece has just been taken as if it can't be
+ *				taken back.  So at depth 0 the captures (and promotions) keep
+ *				being searched until none are worth making.  The player may
+ *				also "stand pat" and take the evaluation as it is, since they
+ *				don't have to capture - if that is already good enough for a
+ *				cutoff there is nothing to search.  Captures are tried most
+ *				valuable victim first.  A capture that can't bring the score
+ *				up to alpha even winning the piece outright (delta pruning),
+ *				or that loses material once the exchange plays out, is skipped.
+ * Invokes:     quiesce() (recursively)
+ *				checkTime()
+ *				evaluate()
+ *				scoreMoves()
+ *				pickMove()
+ *				pieceWeight()
+ *				InCheck() - from the chess class
+ *				GenerateMoves() - from the chess class
+ *				GetCaptured() - from the chess class
+ *				GetPieces() - from the chess class
+ *				SimulateMove() - from the chess class
+ *				UnSimulateMove() - from the chess class
+ * Note:        In check standing pat isn't an option, so every move out of
+ *				check is searched instead, and having none is checkmate.
+ *				Nothing is stored in the transposition table.
+ ***************************************************************************/
+int bot::quiesce(Chess *pChess, int player, int alpha, int beta, int ply)
+{
+	if (checkTime())
+		return 0;
+
+	m_qnodes++;
+
+	bool in_check = pChess->InCheck(player);
+	int best_value = -QUIESCE_MATE;
+
+	// Out of room on the undo stack, just take the evaluation
+	if (ply >= MAX_PLY - 1)
+		return evaluate(pChess, player);
+
+	if (!in_check)
+	{
+		best_value = evaluate(pChess, player);
+
+		if (best_value >= beta)
+			return best_value;
+
+		// Not even taking a queen would get back up to alpha - or taking one
+		// and promoting as well, if a pawn is a step from the last row
+		// (row 1 for white, row 6 for black)
+		int most = m_queen.m_weight;
+		Bitboard seventh = (player == PLAYER_WHITE ? 0xFFULL << 8 : 0xFFULL << 48);
+
+		if (pChess->GetPieces(player == PLAYER_WHITE ? PAWN_WHITE : PAWN_BLACK) & seventh)
+			most += m_queen.m_weight - m_pawn.m_weight;
+
+		if (best_value + most + m_deltaMargin < alpha)
+			return best_value;
+
+		if (best_value > alpha)
+			alpha = best_value;
+	}
+
+	Move move_list[MAX_MOVES];
+	int scores[MAX_MOVES];
+	int num_moves = pChess->GenerateMoves(move_list, player, false, !in_check);
+
+	if (num_moves == 0)
+		return best_value;
+
+	scoreMoves(pChess, move_list, scores, num_moves, Move(), ply);
+
+	for (int i = 0; i < num_moves; i++)
+	{
+		Move m = pickMove(move_list, scores, num_moves, i);
+
+		if (!in_check)
+		{
+			// Captures that lose material come last, and the rest of the
+			// list is no better
+			if (scores[i] < 0)
+				break;
+
+			// Only a queen is worth promoting to here
+			if (m.Promotion() && m.Promoted() != QUEEN_WHITE)
+				continue;
+
+			// Delta pruning - even winning this piece outright wouldn't help
+			int gain = pieceWeight(pChess->GetCaptured(m));
+
+			if (m.Promotion())
+				gain += m_queen.m_weight - m_pawn.m_weight;
+
+			if (best_value + gain + m_deltaMargin < alpha)
+				continue;
+		}
+
+		pChess->SimulateMove(&m);
+		m_line[ply] = m;
+		int value = -quiesce(pChess, other(player), -beta, -alpha, ply + 1);
+		pChess->UnSimulateMove(&m);
+
+		// Out of time, the value can't be trusted
+		if (m_stopSearch)
+			return 0;
+
+		if (value > best_value)
+		{
+			best_value = value;
+
+			if (value > alpha)
+				alpha = value;
+
+			if (value >= beta)
+				break;
+		}
+	}
+
+	return best_value;
+}
+
+/****************************************************************************
+ * Name:        checkTime
+ * Input:       None
+ * Output:      None
+ * Returns:     true if the search has to stop
+ * Description: Counts a node, and every so often sees if the hard time limit
+ *				has passed, or the search has been told to stop, setting
+ *				m_stopSearch if so.  A pondering search also looks for
+ *				whether its guess turned out right.
+ * Invokes:     GetTime()
+ *				ponderHit()
+ * Note:        The first iteration always finishes when the time runs out,
+ *				so there is a move to make however short the time.  Being
+ *				told to stop ends it anyway, the move isn't wanted.
+ ***************************************************************************/
+bool bot::checkTime()
+{
+	m_nodes++;
+
+	if (m_nodes % TIME_CHECK_NODES == 0)
+	{
+		if (m_pPonderHit && *m_pPonderHit)
+			ponderHit();
+
+		if (m_pAbort && *m_pAbort)
+			m_stopSearch = true;
+
+		else if (m_hardLimit && m_searchDepth > 1 && GetTime() >= m_hardLimit)
+			m_stopSearch = true;
+	}
+
+	return m_stopSearch;
+}
+
+/****************************************************************************
+ * Name:        bigPieces
+ * Input:       pChess - pointer to an instance of the chess class
+ *				player - whose pieces to count
+ * Output:      None
+ * Returns:     the number of knights, bishops, rooks and queens the player has
+ * Description: Counts the pieces other than pawns and the king.
+ * Invokes:     GetPieces() - from the chess class
+ * Note:        With few of these, zugzwang is a real danger and passing
+ *				can't be trusted to be worse than moving.
+ ***************************************************************************/
+int bot::bigPieces(Chess *pChess, int player)
+{
+	int offset = (player == PLAYER_WHITE ? 0 : 10);
+
+	return PopCount(pChess->GetPieces(KNIGHT_WHITE + offset) | pChess->GetPieces(BISHOP_WHITE + offset) |
+					pChess->GetPieces(ROOK_WHITE + offset) | pChess->GetPieces(QUEEN_WHITE + offset));
+}
+
+/****************************************************************************
+ * Name:        pieceWeight
+ * Input:       type - a piece of either color, or EMPTY
+ * Output:      None
+ * Returns:     the base weight the bot gives that piece, 0 for EMPTY
+ * Description: Looks up the weight of a piece from the heuristic values.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+int bot::pieceWeight(int type)
+{
+	switch (type % 10)
+	{
+		case PAWN_WHITE:	return m_pawn.m_weight;
+		case ROOK_WHITE:	return m_rook.m_weight;
+		case KNIGHT_WHITE:	return m_knight.m_weight;
+		case BISHOP_WHITE:	return m_bishop.m_weight;
+		case QUEEN_WHITE:	return m_queen.m_weight;
+		case KING_WHITE:	return m_king.m_weight;
+	}
+
+	return 0;
+}
+
+/****************************************************************************
+ * Name:        setDeltaMargin
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Works out how much a capture can change the evaluation on top
+ *				of the weight of the piece taken - the piece taken loses its
+ *				board value and the capturing piece's board value changes, so
+ *				twice the largest board value, plus the randomness and the
+ *				piece count term.
+ * Invokes:     None
+ * Note:        Keeping the margin this wide means delta pruning never skips
+ *				a capture that could have raised alpha.
+ ***************************************************************************/
+void bot::setDeltaMargin()
+{
+	piece *all[6] = { &m_pawn, &m_rook, &m_knight, &m_bishop, &m_queen, &m_king };
+	int largest = 0;
+
+	for (int p = 0; p < 6; p++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			for (int y = 0; y < 8; y++)
+			{
+				int v = all[p]->m_bValue[x][y];
+
+				if (v < 0)
+					v = -v;
+
+				if (v > largest)
+					largest = v;
+			}
+		}
+	}
+
+	m_deltaMargin = 2 * largest + (m_random > 0 ? m_random : 0) + 1;
+}
+
+/****************************************************************************
+ * Name:        printStats
+ * Input:       result - what run() found
+ * Output:      prints the search statistics to the console
+ * Returns:     None
+ * Description: Prints one line about a search - the move and its score,
+ *				the depth, the time and speed, how much of the search was
+ *				the quiescence search, how often the first move tried was
+ *				the one to cause a cutoff, and how often the transposition
+ *				table had the position.
+ * Invokes:     None
+ * Note:        Called after each move when the bot file sets "stats 1".
+ ***************************************************************************/
+void bot::printStats(const SearchResult &result)
+{
+	cout << (char)('a' + result.move.OldX()) << 8 - result.move.OldY()
+		 << (char)('a' + result.move.NewX()) << 8 - result.move.NewY()
+		 << "  score " << result.score
+		 << "  depth " << result.depth
+		 << "  time " << result.time << " ms"
+		 << "  nodes " << result.nodes
+		 << " (" << (result.nodes ? result.qnodes * 100 / result.nodes : 0) << "% quiescence)"
+		 << "  nps " << result.nps
+		 << "  cutoffs " << result.cutoffs
+		 << " (" << (result.cutoffs ? result.firstCutoffs * 100 / result.cutoffs : 0) << "% first move)"
+		 << "  hash hits " << result.ttHits << "/" << result.ttProbes
+		 << endl;
 }
 
 /****************************************************************************
@@ -769,74 +1339,397 @@ void bot::printBoard(Chess* pChess)
 }
 
 /****************************************************************************
- * Name:        orderMoves
- * Input:       move_list - a list of moves
+ * Name:        scoreMoves
+ * Input:       pChess - pointer to an instance of the chess class
+ *				move_list - a list of moves
+ *				scores - filled in with a score for each move
  *				num_moves - the number of moves in the list
+ *				hash_move - best move stored for this position, Move() if none
+ *				ply - how many moves from the top of the search
  * Output:      None
  * Returns:     None
- * Description: This function re-orders a list of moves so that all moves
- *				that capture a piece are at the front of the list.
- * Invokes:     None
- * Note:        Although this algorithm does a sorting-like operation, it is
- *				actually done in linear time, since we don't care exactly what
- *				order the elements are, only that captured moves appear first.
- *				Essentially it is more analogous to a partition routine.
- *				This saves a great deal of time since it is run at every iteration
- *				of our recursive search.
+ * Description: Gives each move a score for how likely it is to cause a cutoff.
+ *				The hash move comes first, then captures and promotions that
+ *				don't lose material, most valuable victim first and least
+ *				valuable attacker first among those (MVV-LVA), then the quiet
+ *				moves, and last the captures that lose material once the
+ *				exchange plays out.  Among the quiet moves the two killers for
+ *				this ply come first, then the countermove to the move just
+ *				made, then the rest by their history score.
+ * Invokes:     see()
+ *				pieceWeight()
+ *				GetCaptured() - from the chess class
+ *				GetBoard() - from the chess class
+ *				WhitePiece() - from the chess class
+ * Note:        Losing captures score below 0, quiet moves 0 or more and below
+ *				the winning captures.
  ***************************************************************************/
-void bot::orderMoves(Move *move_list, int num_moves)
+void bot::scoreMoves(Chess *pChess, Move *move_list, int *scores, int num_moves, Move hash_move, int ply)
 {
-	// A temporary array of moves
-	Move temp[75];
+	// Order to use the attackers in, cheapest first, by piece type
+	static const int attacker_rank[7] = { 0, 0, 3, 1, 2, 4, 5 };
 
-	// Start at the beginning of both lists
-	int index = 0;
-	int i = 0;
+	// The quiet move that last refuted the move just made
+	Move counter;
 
-	// Copy our list into the temporary list
-	for (i = 0; i < num_moves; i++)
-		temp[i] = move_list[i];
-
-	// Loop through the temporary list and copy over any captures first
-	for (i = 0; i < num_moves; i++)
+	if (ply > 0)
 	{
-		if (!temp[i].captured == EMPTY)
-		{
-			move_list[index] = temp[i];
-			index++;
+		Move last = m_line[ply - 1];
+
+		if (!(last == Move()))
+			counter = m_counterMoves[pChess->GetBoard(last.NewX(), last.NewY())][last.To()];
+	}
+
+	for (int i = 0; i < num_moves; i++)
+	{
+		Move m = move_list[i];
+		int captured = pChess->GetCaptured(m);
+
+		if (m == hash_move)
+			scores[i] = MOVE_SCORE_HASH;
+
+		else if (captured != EMPTY || m.Promotion())
+		{
+			int attacker = pChess->GetBoard(m.OldX(), m.OldY());
+			int mvv_lva = 16 * pieceWeight(captured) - attacker_rank[attacker % 10];
+
+			if (m.Promotion())
+				mvv_lva += 16 * (pieceWeight(m.Promoted()) - m_pawn.m_weight);
+
+			// Only worth a look at the exchange when the attacker is worth
+			// more than its victim, otherwise it can't lose
+			if (pieceWeight(attacker) <= pieceWeight(captured) || see(pChess, m) >= 0)
+				scores[i] = MOVE_SCORE_CAPTURE + mvv_lva;
+			else
+				scores[i] = -MOVE_SCORE_CAPTURE + mvv_lva;
+		}
+
+		else if (m == m_killers[ply][0])
+			scores[i] = MOVE_SCORE_KILLER;
+
+		else if (m == m_killers[ply][1])
+			scores[i] = MOVE_SCORE_KILLER - 1;
+
+		else if (m == counter)
+			scores[i] = MOVE_SCORE_KILLER - 2;
+
+		else
+		{
+			int side = (pChess->WhitePiece(pChess->GetBoard(m.OldX(), m.OldY())) ? PLAYER_WHITE : PLAYER_BLACK);
+			scores[i] = m_history[side][m.From()][m.To()];
+
+			// Helper threads each break ties their own way
+			if (m_orderSalt)
+				scores[i] += ((m.data * 2654435761u * m_orderSalt) >> 28) & 15;
 		}
 	}
+}
+
+/****************************************************************************
+ * Name:        quietCutoff
+ * Input:       pChess - pointer to an instance of the chess class
+ *				m - the quiet move that caused a cutoff
+ *				player - the player who made it
+ *				depth - how deep the search below it was
+ *				ply - how many moves from the top of the search
+ * Output:      None
+ * Returns:     None
+ * Description: Remembers a quiet move that caused a cutoff, so it is tried
+ *				early the next time it comes up - as a killer at the same ply,
+ *				as the countermove to the opponent's last move, and in the
+ *				history table, by more the deeper the search was.
+ * Invokes:     GetBoard() - from the chess class
+ * Note:        Must be called with the move already unmade.  When a history
+ *				score gets too big every score is halved, keeping the old
+ *				cutoffs from swamping the new ones.
+ ***************************************************************************/
+void bot::quietCutoff(Chess *pChess, Move m, int player, int depth, int ply)
+{
+	if (!(m == m_killers[ply][0]))
+	{
+		m_killers[ply][1] = m_killers[ply][0];
+		m_killers[ply][0] = m;
+	}
+
+	if (ply > 0)
+	{
+		Move last = m_line[ply - 1];
+
+		if (!(last == Move()))
+			m_counterMoves[pChess->GetBoard(last.NewX(), last.NewY())][last.To()] = m;
+	}
+
+	int &history = m_history[player][m.From()][m.To()];
+
+	history += depth * depth;
+
+	if (history >= HISTORY_MAX)
+		ageHistory();
+}
+
+/****************************************************************************
+ * Name:        ageHistory
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Halves every history score, so recent cutoffs count for more
+ *				than old ones.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+void bot::ageHistory()
+{
+	for (int side = 0; side < 2; side++)
+	{
+		for (int from = 0; from < 64; from++)
+		{
+			for (int to = 0; to < 64; to++)
+				m_history[side][from][to] /= 2;
+		}
+	}
+}
+
+/****************************************************************************
+ * Name:        clearHeuristics
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Forgets the killers, countermoves and history scores.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+void bot::clearHeuristics()
+{
+	int i;
+
+	for (i = 0; i < MAX_PLY; i++)
+	{
+		m_killers[i][0] = Move();
+		m_killers[i][1] = Move();
+		m_line[i] = Move();
+	}
+
+	for (i = 0; i < 17; i++)
+	{
+		for (int to = 0; to < 64; to++)
+			m_counterMoves[i][to] = Move();
+	}
+
+	for (int side = 0; side < 2; side++)
+	{
+		for (int from = 0; from < 64; from++)
+		{
+			for (int to = 0; to < 64; to++)
+				m_history[side][from][to] = 0;
+		}
+	}
+}
+
+/****************************************************************************
+ * Name:        pickMove
+ * Input:       move_list - a list of moves
+ *				scores - the score of each move
+ *				num_moves - the number of moves in the list
+ *				index - how many moves have been picked already
+ * Output:      None
+ * Returns:     the best scored move not yet picked
+ * Description: Swaps the best of the remaining moves (and its score) into
+ *				place at index and returns it.
+ * Invokes:     None
+ * Note:        Picking one move at a time rather than sorting the whole list
+ *				saves the work on the rest of the list when the first few moves
+ *				cause a cutoff, which is most of the time.
+ ***************************************************************************/
+Move bot::pickMove(Move *move_list, int *scores, int num_moves, int index)
+{
+	int pick = index;
+
+	for (int i = index + 1; i < num_moves; i++)
+	{
+		if (scores[i] > scores[pick])
+			pick = i;
+	}
+
+	Move m = move_list[pick];
+	int score = scores[pick];
+
+	move_list[pick] = move_list[index];
+	scores[pick] = scores[index];
+	move_list[index] = m;
+	scores[index] = score;
+
+	return m;
+}
+
+/****************************************************************************
+ * Name:        see
+ * Input:       pChess - pointer to an instance of the chess class
+ *				m - a capture or promotion
+ * Output:      None
+ * Returns:     what the move wins (or loses, if negative) once every
+ *				capture back and forth on its square has been made
+ * Description: Static exchange evaluation - plays out the captures on the
+ *				destination square without making any moves, each side using
+ *				its cheapest attacker and stopping when it would lose by going
+ *				on.  Taking pieces out of the occupancy as they are used lets
+ *				the sliders lined up behind them join in.
+ * Invokes:     pieceWeight()
+ *				Attackers() - from the chess class
+ *				GetPieces() - from the chess class
+ *				GetOccupancy() - from the chess class
+ *				GetCaptured() - from the chess class
+ *				GetBoard() - from the chess class
+ *				WhitePiece() - from the chess class
+ * Note:        Pins are ignored, and the values are the bot's own weights.
+ ***************************************************************************/
+int bot::see(Chess *pChess, Move m)
+{
+	// Cheapest attackers first
+	static const int order[6] = { PAWN_WHITE, KNIGHT_WHITE, BISHOP_WHITE, ROOK_WHITE, QUEEN_WHITE, KING_WHITE };
+
+	int to = m.To();
+	int attacker = pChess->GetBoard(m.OldX(), m.OldY());
+	int player = (pChess->WhitePiece(attacker) ? PLAYER_WHITE : PLAYER_BLACK);
+	Bitboard occupied = pChess->GetOccupancy(PLAYER_WHITE) | pChess->GetOccupancy(PLAYER_BLACK);
+
+	// gain[d] is what the side making capture d stands to win if it is the
+	// last capture made
+	int gain[32];
+	int d = 0;
+
+	gain[0] = pieceWeight(pChess->GetCaptured(m));
 
-	// Now fill the remainder of the list with non-capture moves
-	for (i = 0; i < num_moves; i++)
+	// The piece left standing on the square, which the next capture wins
+	int on_square = pieceWeight(attacker);
+
+	if (m.Promotion())
+	{
+		gain[0] += pieceWeight(m.Promoted()) - m_pawn.m_weight;
+		on_square = pieceWeight(m.Promoted());
+	}
+
+	if (m.Enpassant())
+		occupied ^= SQUARE_BIT(SQUARE(m.NewX(), m.OldY()));
+
+	occupied ^= SQUARE_BIT(m.From());
+	player = other(player);
+
+	while (d < 31)
 	{
-		if (temp[i].captured == EMPTY)
+		Bitboard attackers = pChess->Attackers(to, player, occupied) & occupied;
+
+		if (!attackers)
+			break;
+
+		// Find the cheapest attacker
+		int from = -1;
+		int type = EMPTY;
+
+		for (int i = 0; i < 6 && from < 0; i++)
 		{
-			move_list[index] = temp[i];
-			index++;
+			type = order[i] + (player == PLAYER_WHITE ? 0 : 10);
+
+			Bitboard b = attackers & pChess->GetPieces(type);
+
+			if (b)
+				from = LowestSquare(b);
+		}
+
+		d++;
+		gain[d] = on_square - gain[d - 1];
+
+		// Neither side can do better by going on, so this capture won't
+		// be made
+		if ((-gain[d - 1] > gain[d] ? -gain[d - 1] : gain[d]) < 0)
+		{
+			d--;
+			break;
 		}
+
+		on_square = pieceWeight(type);
+		occupied ^= SQUARE_BIT(from);
+		player = other(player);
 	}
+
+	// Work back from the end, each side only capturing if it gains by it
+	while (d > 0)
+	{
+		if (-gain[d - 1] < gain[d])
+			gain[d - 1] = -gain[d];
+
+		d--;
+	}
+
+	return gain[0];
 }
 
 /****************************************************************************
  * Name:        run
  * Input:       pChess - instance of the chess class
+ *		cancel - stops the search when set, 0 if it can't be stopped
+ *		ponder_hit - for a search of the position after the move the
+ *			opponent is expected to make, set when they make it; 0
+ *			for a normal search
  * Output:      None
- * Returns:     a Move
- * Description: This function actually runs the logic behind the AI.  This basically
- *		establishes the proper parameters and calls the search function.
- * Invokes:     negaMax()
- * Note:        None
+ * Returns:     a SearchResult - the move, and what the search did
+ * Description: This function actually runs the logic behind the AI.  It searches
+ *		one ply deep, then two, and so on (iterative deepening), each search
+ *		trying the last one's best move first, and looking only for scores
+ *		close to the last one's (the aspiration window).  Without a time control it
+ *		stops at the depth from the threshold table.  With one it keeps going
+ *		until the soft time limit passes before an iteration starts, or the
+ *		hard limit passes during one, in which case that iteration is thrown
+ *		out and the move from the last complete one is made.  A bot with
+ *		more than one thread runs helper searches alongside (Lazy SMP).
+ * Invokes:     iterate()
+ *		helperSearch() - on the helper threads
+ *		setTimeLimits()
+ *		ponderHit()
+ *		guessReply()
+ *		printStats()
+ *		GetTime()
+ *		Resize(), NewSearch() - from the transposition table
+ * Note:        The threshold table caps a timed search unless the bot file
+ *		turns depth_cap off.  Each iteration is cheap next to the one after
+ *		it, so the shallow ones cost little and fill the table with moves
+ *		that make the deep ones faster.  A cancelled search returns
+ *		whatever it has, maybe no move at all, and doesn't touch the clock,
+ *		since the move won't be made - so run() can go on another thread
+ *		and be cancelled from the one that started it.  A pondering search
+ *		runs with no time limit while the opponent thinks; if they make the
+ *		expected move it carries on, clock started, from where it got to,
+ *		and if not it is cancelled, leaving its results in the table.
  ***************************************************************************/
-Move bot::run(Chess *pChess)
+SearchResult bot::run(Chess *pChess, const std::atomic<bool> *cancel, const std::atomic<bool> *ponder_hit)
 {
 	int num_pieces = pChess->GetNumPieces();
-
-	m_searchDepth = m_threshold[num_pieces - 1];
+	bool timed = (m_moveTime > 0 || m_baseTime > 0);
+	int max_depth = m_threshold[num_pieces - 1];
 
 	// Safety check (don't want to search negative depths)
-	if (m_searchDepth < 1)
-		m_searchDepth = 1;
+	if (max_depth < 1)
+		max_depth = 1;
+
+	if (timed && !m_depthCap)
+		max_depth = MAX_SEARCH_DEPTH;
+
+	// Set up the transposition table the first time, or if the size changed
+	int hash_size = (m_hashSize > 0 ? m_hashSize : s_defaultHashSize);
+
+	if (m_table->GetSize() != hash_size)
+		m_table->Resize(hash_size);
+
+	m_table->NewSearch();
+
+	// The killers were for positions two moves back, but the history and
+	// countermoves still mostly hold, so just let the old scores fade
+	for (int ply = 0; ply < MAX_PLY; ply++)
+	{
+		m_killers[ply][0] = Move();
+		m_killers[ply][1] = Move();
+	}
+
+	ageHistory();
 
 	//Used for Testing Purposes - prints the current players turn
 	//if(pChess->GetTurn() == PLAYER_WHITE)
@@ -844,20 +1737,300 @@ Move bot::run(Chess *pChess)
 	//else
 	//	cout << "*********************BLACK PLAYER POSSIBLE MOVES*********************\n";	
 
-	// Used for timing tests
-	//unsigned long time = GetTime();
+	unsigned long long start = GetTime();
+
+	m_searchStart = start;
+	m_pPonderHit = ponder_hit;
+
+	// A pondering search is on the opponent's time, so it has no limit
+	// until its guess turns out right
+	if (m_pPonderHit && !*m_pPonderHit)
+	{
+		m_softLimit = 0;
+		m_hardLimit = 0;
+	}
+	else
+	{
+		m_pPonderHit = 0;
+		setTimeLimits(m_searchStart);
+	}
+
+	m_pAbort = cancel;
+
+	// With more than one thread, start helpers searching the same position
+	// on copies of the board.  They share nothing with this search but the
+	// transposition table - which is the point, they fill it with results
+	// this search can use.  Every other helper starts a ply deeper and each
+	// orders its quiet moves a little differently, so they don't all
+	// search the same positions in step.
+	std::atomic<bool> abort(false);
+	std::vector<bot *> helpers;
+	std::vector<std::thread> threads;
+
+	for (int t = 1; t < m_threads; t++)
+	{
+		bot *helper = new bot(*this);
+
+		helper->m_pAbort = &abort;
+		helper->m_pPonderHit = 0;
+		helper->m_orderSalt = t;
+		helper->m_softLimit = 0;
+		helper->m_hardLimit = 0;
+
+		helpers.push_back(helper);
+		threads.push_back(std::thread(&bot::helperSearch, helper, *pChess, 1 + t % 2, max_depth));
+	}
+
+	Move best = iterate(pChess, 1, max_depth);
+
+	// Stop the helpers, whatever they were doing, and wait for them
+	abort = true;
+
+	SearchResult result;
+
+	result.move = best;
+	result.score = m_scoreDone;
+	result.depth = m_depthDone;
+	result.nodes = m_nodes;
+	result.qnodes = m_qnodes;
+	result.cutoffs = m_cutoffs;
+	result.firstCutoffs = m_firstCutoffs;
+	result.ttProbes = m_ttProbes;
+	result.ttHits = m_ttHits;
+
+	for (int t = 0; t < (int)threads.size(); t++)
+	{
+		threads[t].join();
+
+		result.nodes += helpers[t]->m_nodes;
+		result.qnodes += helpers[t]->m_qnodes;
+		result.cutoffs += helpers[t]->m_cutoffs;
+		result.firstCutoffs += helpers[t]->m_firstCutoffs;
+		result.ttProbes += helpers[t]->m_ttProbes;
+		result.ttHits += helpers[t]->m_ttHits;
+
+		delete helpers[t];
+	}
+
+	m_pAbort = 0;
+
+	// Divide by 1000 to get milliseconds
+	result.time = (unsigned long)((GetTime() - start) / 1000);
+	result.nps = (result.time > 0 ? (unsigned long)(result.nodes * 1000ULL / result.time) : 0);
+
+	if (cancel && *cancel)
+	{
+		m_pPonderHit = 0;
+		return result;
+	}
+
+	// A pondering search that finished before the opponent moved has used
+	// none of the bot's time, whether its guess is right or not
+	if (m_pPonderHit)
+		ponderHit();
 
-	// Run the actual search
-	Move move = negaMax(pChess, m_searchDepth, pChess->GetTurn(), -10*CHECKMATE, 10*CHECKMATE);
+	m_pPonderHit = 0;
+
+	// What the opponent is expected to reply, to ponder on
+	m_ponderMove = guessReply(pChess, best);
 
 	// Divide by 1000 to get milliseconds
-	//unsigned long moveTime = (GetTime() - time)/1000;
+	unsigned long moveTime = (unsigned long)((GetTime() - m_searchStart) / 1000);
+
+	m_totalTime += moveTime;
+
+	// Take the time off the game clock, and add the increment
+	if (m_baseTime > 0)
+	{
+		m_clock -= (long)moveTime;
+
+		if (m_clock < 0)
+			m_clock = 0;
 
-	//m_totalTime += moveTime;
+		m_clock += m_increment;
+	}
 
-	//cout << "Move took: " << moveTime << " milliseconds" << endl;	
+	if (m_printStats)
+		printStats(result);
 
-	return move;
+	return result;
+}
+
+/****************************************************************************
+ * Name:        iterate
+ * Input:       pChess - instance of the chess class
+ *				start_depth - depth of the first iteration
+ *				max_depth - depth of the last iteration
+ * Output:      None
+ * Returns:     the best move of the last iteration to finish
+ * Description: The iterative deepening loop - searches start_depth plies
+ *				deep, then one more, and so on up to max_depth, each time
+ *				looking only for scores close to the last one's (the
+ *				aspiration window) and widening the window if the score
+ *				falls outside it.  It stops early once a mate is found, when
+ *				the soft time limit passes between iterations, or when the
+ *				search is stopped during one, in which case that iteration
+ *				is thrown out.
+ * Invokes:     negaMax()
+ *				ponderHit()
+ *				GetTime()
+ * Note:        A move that fails high at the top is kept even if its
+ *				iteration doesn't finish, it is already better than the last.
+ ***************************************************************************/
+Move bot::iterate(Chess *pChess, int start_depth, int max_depth)
+{
+	m_stopSearch = false;
+	m_nodes = 0;
+	m_qnodes = 0;
+	m_cutoffs = 0;
+	m_firstCutoffs = 0;
+	m_ttProbes = 0;
+	m_ttHits = 0;
+	m_depthDone = 0;
+	m_scoreDone = 0;
+	m_bestMove = Move();
+
+	Move best;
+
+	// Half-width of the aspiration window - the randomness alone can move
+	// the score this much
+	int window = m_pawn.m_weight / 2 + (m_random > 0 ? m_random : 0) + 1;
+	int value = 0;
+
+	for (m_searchDepth = start_depth; m_searchDepth <= max_depth; m_searchDepth++)
+	{
+		int alpha = -SEARCH_INFINITY;
+		int beta = SEARCH_INFINITY;
+		int delta = window;
+
+		// The score rarely moves far from one iteration to the next, so
+		// look only near the last one - a narrow window prunes more.  If
+		// the score lands outside, widen that side and search again.
+		if (m_searchDepth >= ASPIRATION_DEPTH && value > -CHECKMATE && value < CHECKMATE)
+		{
+			alpha = value - delta;
+			beta = value + delta;
+		}
+
+		while (true)
+		{
+			// Run the actual search (it leaves the move to make in m_bestMove)
+			value = negaMax(pChess, m_searchDepth, 0, pChess->GetTurn(), alpha, beta);
+
+			if (m_stopSearch)
+				break;
+
+			// A score outside a window that is already open all the way
+			// can't be improved on by searching again
+			if (alpha <= -SEARCH_INFINITY && beta >= SEARCH_INFINITY)
+				break;
+
+			delta *= 4;
+
+			if (value <= alpha)
+				alpha = (delta > m_queen.m_weight ? -SEARCH_INFINITY : alpha - delta);
+			else if (value >= beta)
+			{
+				// The move that failed high is better than the last
+				// iteration's, and worth playing if time runs out
+				best = m_bestMove;
+				beta = (delta > m_queen.m_weight ? SEARCH_INFINITY : beta + delta);
+			}
+			else
+				break;
+		}
+
+		if (m_stopSearch)
+			break;
+
+		best = m_bestMove;
+		m_depthDone = m_searchDepth;
+		m_scoreDone = value;
+
+		// A forced mate either way won't change with more depth
+		if (value >= CHECKMATE || value <= -CHECKMATE)
+			break;
+
+		// The opponent made the expected move, the clock starts now
+		if (m_pPonderHit && *m_pPonderHit)
+			ponderHit();
+
+		// Not enough time left for the next, longer, iteration
+		if (m_softLimit && GetTime() >= m_softLimit)
+			break;
+	}
+
+	return best;
+}
+
+/****************************************************************************
+ * Name:        helperSearch
+ * Input:       position - the helper's own copy of the board
+ *				start_depth - depth of the first iteration
+ *				max_depth - depth of the last iteration
+ * Output:      None
+ * Returns:     None
+ * Description: What a helper thread runs - the same iterative deepening as
+ *				the main search, until it is done or told to stop.
+ * Invokes:     iterate()
+ * Note:        The result is thrown away, only what it leaves in the shared
+ *				transposition table matters.
+ ***************************************************************************/
+void bot::helperSearch(Chess position, int start_depth, int max_depth)
+{
+	iterate(&position, start_depth, max_depth);
+}
+
+/****************************************************************************
+ * Name:        setTimeLimits
+ * Input:       start - time the search started, in microseconds
+ * Output:      None
+ * Returns:     None
+ * Description: Sets the soft and hard limits for a search.  With a fixed time
+ *		per move the hard limit is that time and the soft limit half of it,
+ *		since the next iteration would take longer than what is left.  With
+ *		a game clock the bot plans on a 30th of the time left plus most of
+ *		the increment, and lets a search run over that to twice as long, but
+ *		never more than half of what is left.
+ * Invokes:     None
+ * Note:        Without a time control both limits are 0, meaning none.
+ ***************************************************************************/
+void bot::setTimeLimits(unsigned long long start)
+{
+	long soft = 0;
+	long hard = 0;
+
+	if (m_moveTime > 0)
+	{
+		soft = m_moveTime / 2;
+		hard = m_moveTime;
+	}
+	else if (m_baseTime > 0)
+	{
+		long target = m_clock / 30 + m_increment * 3 / 4;
+
+		soft = target / 2;
+		hard = target * 2;
+
+		if (hard > m_clock / 2)
+			hard = m_clock / 2;
+
+		if (soft > hard)
+			soft = hard;
+	}
+	else
+	{
+		m_softLimit = 0;
+		m_hardLimit = 0;
+		return;
+	}
+
+	// Always allow a little time, or nothing past the first ply gets searched
+	if (hard < 1)
+		hard = 1;
+
+	m_softLimit = start + (unsigned long long)soft * 1000;
+	m_hardLimit = start + (unsigned long long)hard * 1000;
 }
 
 /****************************************************************************
@@ -877,6 +2050,71 @@ int bot::other(int player)
 		return PLAYER_WHITE;
 }
 
+/****************************************************************************
+ * Name:        ponderHit
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: The opponent made the move a pondering search expected, so
+ *		it is now searching on the bot's own time - starts the clock and
+ *		sets the time limits from now.
+ * Invokes:     setTimeLimits()
+ *		GetTime()
+ * Note:        Only called on the searching thread, which owns the limits.
+ ***************************************************************************/
+void bot::ponderHit()
+{
+	m_pPonderHit = 0;
+	m_searchStart = GetTime();
+
+	setTimeLimits(m_searchStart);
+}
+
+/****************************************************************************
+ * Name:        guessReply
+ * Input:       pChess - instance of the chess class
+ *		m - the move about to be made
+ * Output:      None
+ * Returns:     the move the opponent is expected to reply with, Move() if
+ *		there is no guess
+ * Description: Makes the move and takes the reply from the transposition
+ *		table, the second move of the line the search expects.
+ * Invokes:     SimulateMove(), UnSimulateMove() - from the chess class
+ *		GenerateMoves() - from the chess class
+ *		Probe() - from the transposition table
+ * Note:        The table move is checked against the legal moves, since
+ *		another position can have written over the entry.
+ ***************************************************************************/
+Move bot::guessReply(Chess *pChess, Move m)
+{
+	if (m == Move())
+		return Move();
+
+	Move reply;
+	TTEntry entry;
+
+	pChess->SimulateMove(&m);
+
+	if (m_table->Probe(pChess->GetHash(), entry) && !(entry.move == Move()))
+	{
+		Move move_list[MAX_MOVES];
+		int num_moves = pChess->GenerateMoves(move_list, pChess->GetTurn());
+
+		for (int i = 0; i < num_moves; i++)
+		{
+			if (move_list[i] == entry.move)
+			{
+				reply = entry.move;
+				break;
+			}
+		}
+	}
+
+	pChess->UnSimulateMove(&m);
+
+	return reply;
+}
+
 /****************************************************************************
  * Name:        printBotValues
  * Input:       None
@@ -980,19 +2218,123 @@ unsigned long bot::getTotalTime()
 	return m_totalTime;
 }
 
+/****************************************************************************
+ * Name:        ponders
+ * Input:       None
+ * Output:      None
+ * Returns:     bool - m_ponder
+ * Description: Returns whether the bot file asks for the bot to search on
+ *		the opponent's time.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+bool bot::ponders()
+{
+	return m_ponder;
+}
+
+/****************************************************************************
+ * Name:        getPonderMove
+ * Input:       None
+ * Output:      None
+ * Returns:     Move - m_ponderMove
+ * Description: Returns the reply the last search expects to its move, the
+ *		one to ponder on.
+ * Invokes:     None
+ * Note:        Move() if the search had no guess.
+ ***************************************************************************/
+Move bot::getPonderMove()
+{
+	return m_ponderMove;
+}
+
+/****************************************************************************
+ * Name:        newGame
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Gets the bot ready for a new game - the game clock goes back
+ *		to the base time, the transposition table and move ordering
+ *		heuristics are emptied, and the randomness is picked anew, so
+ *		games differ but each plays out the same from the same seed.
+ * Invokes:     clearHeuristics()
+ *		nextRandom()
+ *		Clear() - from the transposition table
+ * Note:        Called by loadAI(), and should be called on "New Game".
+ ***************************************************************************/
+void bot::newGame()
+{
+	m_clock = m_baseTime;
+	m_ponderMove = Move();
+	m_noiseKey = nextRandom();
+	m_noiseKey = (m_noiseKey << 32) | nextRandom();
+	m_table->Clear();
+	clearHeuristics();
+}
+
+/****************************************************************************
+ * Name:        setDefaultHashSize
+ * Input:       megabytes - int
+ * Output:      None
+ * Returns:     None
+ * Description: Sets the transposition table size used by every bot whose
+ *		file has no BEGIN_HASH section.
+ * Invokes:     None
+ * Note:        Takes effect at each bot's next search.
+ ***************************************************************************/
+void bot::setDefaultHashSize(int megabytes)
+{
+	if (megabytes > 0)
+		s_defaultHashSize = megabytes;
+}
+
+/****************************************************************************
+ * Name:        setDefaultSeed
+ * Input:       seed - unsigned long long
+ * Output:      None
+ * Returns:     None
+ * Description: Sets the seed every bot's random numbers start from.
+ * Invokes:     None
+ * Note:        Takes effect the next time each bot is loaded - loadAI() or
+ *		loadDefault().
+ ***************************************************************************/
+void bot::setDefaultSeed(unsigned long long seed)
+{
+	s_defaultSeed = seed;
+}
+
+/****************************************************************************
+ * Name:        nextRandom
+ * Input:       None
+ * Output:      None
+ * Returns:     unsigned int - a random number
+ * Description: Steps the bot's xorshift64* generator.  Each bot has its own,
+ *		so its numbers depend only on its seed, not on anything else
+ *		in the program drawing random numbers.
+ * Invokes:     None
+ * Note:        The state is never 0, which xorshift can't leave.
+ ***************************************************************************/
+unsigned int bot::nextRandom()
+{
+	m_rng ^= m_rng >> 12;
+	m_rng ^= m_rng << 25;
+	m_rng ^= m_rng >> 27;
+
+	return (unsigned int)((m_rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
 /****************************************************************************
  * Name:        GetTime
  * Input:       None
  * Output:      None
- * Returns:     unsigned long - the current time
+ * Returns:     unsigned long long - the current time
  * Description: This function returns the current time in microseconds.
  * Invokes:     None
- * Note:        None
+ * Note:        Uses the steady clock, which never jumps like the wall clock,
+ *		so only the difference between two calls means anything.
  ***************************************************************************/
-unsigned long bot::GetTime()
+unsigned long long bot::GetTime()
 {
-    //timeval t;
-	//gettimeofday(&t, NULL);
-	//return t.tv_sec * 1000000ul + t.tv_usec;
-	return 0;
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
 }
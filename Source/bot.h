@@ -22,12 +22,67 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include "chess.h"
+#include "ttable.h"
 using namespace std;
 
 #define CHECKMATE	65535
 
-struct Move;
-class Chess;
+// Deepest a timed search will go when the threshold table doesn't cap it
+#define MAX_SEARCH_DEPTH	64
+
+// Bound beyond any score the search can return - mates score up to
+// MAX_SEARCH_DEPTH * CHECKMATE
+#define SEARCH_INFINITY		(2 * MAX_SEARCH_DEPTH * CHECKMATE)
+
+// First iteration to search with an aspiration window around the last score
+#define ASPIRATION_DEPTH	3
+
+// Most threads a bot can search with
+#define MAX_THREADS			64
+
+// How many nodes the search visits between looks at the clock
+#define TIME_CHECK_NODES	1024
+
+// Move ordering scores - the hash move, then captures that don't lose
+// material, above 0; quiet moves at 0; losing captures below
+#define MOVE_SCORE_HASH		(1 << 30)
+#define MOVE_SCORE_CAPTURE	(1 << 24)
+
+// Quiet moves - the killers and the countermove, then the history scores,
+// which are halved when one reaches HISTORY_MAX
+#define MOVE_SCORE_KILLER	(1 << 22)
+#define HISTORY_MAX			(1 << 20)
+
+// Score for being mated in the quiescence search, below any mate negaMax
+// finds since those come sooner
+#define QUIESCE_MATE	(CHECKMATE / 2)
+
+// Seed for the bots' random numbers until setDefaultSeed() picks another
+#define DEFAULT_SEED	20070415ULL
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Name:        SearchResult
+// Description: The move a search found, and what it took to find it, as
+//		handed back by run().  The counts take in the helper threads.
+/////////////////////////////////////////////////////////////////////////////
+struct SearchResult
+{
+	Move move;					// the move to make, none if cancelled early
+	int score;					// its score for the side to move
+	int depth;					// deepest iteration that finished
+	unsigned long time;			// how long the search took, in milliseconds
+	unsigned long nodes;		// positions searched
+	unsigned long qnodes;		// of those, in the quiescence search
+	unsigned long nps;			// nodes per second
+	unsigned long cutoffs;		// beta cutoffs in the main search
+	unsigned long firstCutoffs;	// of those, by the first move tried
+	unsigned long ttProbes;		// transposition table lookups
+	unsigned long ttHits;		// of those, that found the position
+};
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -47,8 +102,15 @@ public:
 	// Destructor for the bot class
 	~bot();
 
-	// Interface to run the AI search
-	Move run(Chess *pChess);
+	// Interface to run the AI search, which stops early if cancel gets set,
+	// and has no time limit until ponder_hit gets set if given one
+	SearchResult run(Chess *pChess, const std::atomic<bool> *cancel = 0, const std::atomic<bool> *ponder_hit = 0);
+
+	// Whether the bot searches on the opponent's time
+	bool ponders();
+
+	// The reply the last search expects, Move() if it has no guess
+	Move getPonderMove();
 
 	// Loads AI heuristic values from a file
 	void loadAI(std::string s);
@@ -59,12 +121,24 @@ public:
 	// Prints the state of the board to the console
 	void printBoard(Chess* pChess);
 
+	// Prints what a search did to the console
+	void printStats(const SearchResult &result);
+
 	// Loads a default bot (simple heuristics)
 	void loadDefault();
 
 	// Gets the total time so far
 	unsigned long getTotalTime();
 
+	// Starts a new game - winds the clock back and forgets old positions
+	void newGame();
+
+	// Sets the transposition table size (MB) for bots that don't give one
+	static void setDefaultHashSize(int megabytes);
+
+	// Sets the seed for the random numbers of bots loaded from now on
+	static void setDefaultSeed(unsigned long long seed);
+
 private:
 
 	// Holds heuristic values for a particular type of piece
@@ -79,24 +153,75 @@ private:
 	// Loads data from a file
 	void loadData(std::istringstream &ss, std::string &state);
 
+	// Searches deeper and deeper until out of depth or time
+	Move iterate(Chess *pChess, int start_depth, int max_depth);
+
+	// What a helper thread runs, on its own copy of the board
+	void helperSearch(Chess position, int start_depth, int max_depth);
+
 	// The actual search - uses the heuristic values to determine the best move	
-	Move negaMax(Chess *pChess, int depth, int player, int alpha, int beta);
+	int negaMax(Chess *pChess, int depth, int ply, int player, int alpha, int beta);
+
+	// Searches captures until the position is quiet, then evaluates it
+	int quiesce(Chess *pChess, int player, int alpha, int beta, int ply);
 
 	// Evaluates the board at a given state
 	int evaluate(Chess *pChess, int player);
 
-	// takes a generated list of moves and orders them - "capture" moves first
-	void orderMoves(Move* move_list, int num_moves);
+	// Counts a player's pieces other than pawns and the king
+	int bigPieces(Chess *pChess, int player);
+
+	// Returns the bot's weight for a piece of either color
+	int pieceWeight(int type);
+
+	// Works out m_deltaMargin from the heuristic values
+	void setDeltaMargin();
+
+	// Counts a node and sees if the time is up, returns true to stop
+	bool checkTime();
+
+	// Scores a generated list of moves - hash move, then captures, then the rest
+	void scoreMoves(Chess *pChess, Move* move_list, int *scores, int num_moves, Move hash_move, int ply);
+
+	// Remembers a quiet move that caused a cutoff, for ordering later
+	void quietCutoff(Chess *pChess, Move m, int player, int depth, int ply);
+
+	// Halves the history scores
+	void ageHistory();
+
+	// Forgets the killers, countermoves and history
+	void clearHeuristics();
+
+	// Swaps the best scored move left into place and returns it
+	Move pickMove(Move* move_list, int *scores, int num_moves, int index);
+
+	// Plays out the captures on a move's square, returns the material won
+	int see(Chess *pChess, Move m);
 
 	// Returns the opponent of a given player
 	int other(int player);
 
+	// Returns the next number from the bot's random number generator
+	unsigned int nextRandom();
+
+	// Starts the clock for a pondering search whose guess was right
+	void ponderHit();
+
+	// Looks up the reply to a move in the transposition table
+	Move guessReply(Chess *pChess, Move m);
+
+	// Works out when the search has to stop, from the time control
+	void setTimeLimits(unsigned long long start);
+
 	// Returns the time in microseconds
-	unsigned long GetTime();
+	unsigned long long GetTime();
 
 	// The number of ply to look ahead
 	int m_searchDepth;
 
+	// The best move found at the top level of the last search
+	Move m_bestMove;
+
 	// The piece values
 	piece m_king;
 	piece m_queen;
@@ -115,9 +240,125 @@ private:
 
 	// how random the bot should act
 	int m_random;
+
+	// State of the bot's random number generator (xorshift64*), and the
+	// key that picks how much randomness each position gets this game
+	unsigned long long m_rng;
+	HashKey m_noiseKey;
+
+	// Seed for the generator of bots loaded from now on
+	static unsigned long long s_defaultSeed;
 
+	// Which bot this is, in the order they were made, mixed into the seed
+	// so no two bots draw the same numbers; and how many have been made
+	int m_botNumber;
+	static int s_botCount;
+
 	// total time so far
 	unsigned long m_totalTime;
+
+	// Remembers positions already searched, kept from move to move, and
+	// shared with the helper threads (a copy of the bot shares the table)
+	std::shared_ptr<TransTable> m_table;
+
+	// Size of the table in MB, 0 to use the default
+	int m_hashSize;
+
+	// Table size for bots that don't set m_hashSize
+	static int s_defaultHashSize;
+
+	// Null move pruning from the BEGIN_SEARCH section - whether to use it,
+	// how many extra plies shallower the search after a pass is, and the
+	// most pieces besides pawns and the king a player can have for a
+	// cutoff to be checked with a real search (zugzwang)
+	bool m_nullMove;
+	int m_nullReduction;
+	int m_nullVerify;
+
+	// Set while checking a null move cutoff, so it doesn't pass again
+	bool m_noNull;
+
+	// How many threads to search with, from the BEGIN_SEARCH section
+	int m_threads;
+
+	// Whether to ponder, from the BEGIN_SEARCH section, and the reply the
+	// last search expects
+	bool m_ponder;
+	Move m_ponderMove;
+
+	// Set by whoever called run() when a pondering search's guess turns out
+	// right, 0 when the search isn't pondering (any more)
+	const std::atomic<bool> *m_pPonderHit;
+
+	// Set to stop the search - by the main search when a helper thread is
+	// done, or by whoever called run() when the move isn't wanted - and a
+	// number to vary the move ordering by (0 for the main search)
+	const std::atomic<bool> *m_pAbort;
+	unsigned int m_orderSalt;
+
+	// Late move reductions - whether to use them, the least depth left to
+	// reduce at, and how many moves are searched in full before reducing
+	bool m_lmr;
+	int m_lmrDepth;
+	int m_lmrMoves;
+
+	// Time control in milliseconds, 0 if not used - either a fixed time
+	// for each move, or a time for the whole game plus an increment
+	int m_moveTime;
+	int m_baseTime;
+	int m_increment;
+
+	// Whether the threshold table still limits the depth of a timed search
+	bool m_depthCap;
+
+	// Time left on the game clock in milliseconds
+	long m_clock;
+
+	// Deadlines for the current search in microseconds, 0 for none - no new
+	// iteration starts after the soft one, the search stops at the hard one
+	unsigned long long m_softLimit;
+	unsigned long long m_hardLimit;
+
+	// When the current search started on the bot's own time, in microseconds
+	unsigned long long m_searchStart;
+
+	// Set when the hard limit passes, to unwind the search
+	bool m_stopSearch;
+
+	// Nodes visited by the current search
+	unsigned long m_nodes;
+
+	// What else the current search has done, for the SearchResult
+	unsigned long m_qnodes;
+	unsigned long m_cutoffs;
+	unsigned long m_firstCutoffs;
+	unsigned long m_ttProbes;
+	unsigned long m_ttHits;
+
+	// Depth and score of the last iteration to finish
+	int m_depthDone;
+	int m_scoreDone;
+
+	// Whether to print the SearchResult after each move, from the
+	// BEGIN_SEARCH section
+	bool m_printStats;
+
+	// Quiet moves that caused a cutoff, two for each ply of the search
+	Move m_killers[MAX_PLY][2];
+
+	// How well each quiet move has done, by side, from and to squares
+	int m_history[2][64][64];
+
+	// The quiet move that refuted each move, by the piece moved and where to
+	Move m_counterMoves[17][64];
+
+	// The move made at each ply of the line being searched
+	Move m_line[MAX_PLY];
+
+	// Most a capture can change the score by besides the weight of the
+	// piece taken - the quiescence search skips captures that can't
+	// bring the score up to alpha even with this much on top
+	int m_deltaMargin;
 };
 
 #endif
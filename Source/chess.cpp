@@ -19,20 +19,365 @@
 #else
 #endif
 
+#include <cstdlib>
+#include <sstream>
+
 #include "chess.h"
 
+// Squares attacked by a piece standing on each square of an empty board
+static Bitboard knight_attacks[64];
+static Bitboard king_attacks[64];
+static Bitboard pawn_attacks[2][64];
+
+// For two squares on the same row, column or diagonal: the squares strictly
+// between them, and the whole line through both (edge to edge).  Empty for
+// squares that don't line up.
+static Bitboard between[64][64];
+static Bitboard lines[64][64];
+
+// Zobrist keys - one random number for each piece on each square, one for
+// each castling flag, one for each en passant column and one for black to
+// move.  A position's key is all of its numbers xor'd together.
+static HashKey piece_keys[KING_BLACK + 1][64];
+static HashKey castle_keys[4];
+static HashKey enpassant_keys[8];
+static HashKey turn_key;
+
+// Step directions (dx, dy) for the sliding pieces
+static const int rook_directions[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+static const int bishop_directions[4][2] = { {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+
+// Magic bitboard lookup for one square of one kind of slider.  The blockers
+// that matter (mask) are multiplied by the magic number, and the top bits of
+// the product index straight into that square's slice of the attack table.
+struct Magic
+{
+	Bitboard mask;
+	Bitboard magic;
+	Bitboard *attacks;
+	int shift;
+};
+
+static Magic rook_magics[64];
+static Magic bishop_magics[64];
+
+// Every square's slice of attack sets, packed back to back
+static Bitboard rook_table[0x19000];
+static Bitboard bishop_table[0x1480];
+
+// Magic numbers for each square.  These were found by trying sparse random
+// numbers until one sent every subset of the square's blockers to a slot
+// that no subset with a different attack set also uses.
+static const Bitboard rook_magic_numbers[64] =
+{
+	0x1480004000248010ULL, 0x0840001000402008ULL, 0x0200084210220082ULL, 0xF080040801821000ULL,
+	0x0180040080A80002ULL, 0x1200080402000110ULL, 0x5480820000800100ULL, 0x0100008040220100ULL,
+	0x0500800080400024ULL, 0x0210C00020005000ULL, 0x0052002080420014ULL, 0x7000800800100080ULL,
+	0x0091000800110204ULL, 0x0006001002002428ULL, 0x42C1000441008200ULL, 0x0001000100004082ULL,
+	0x1080004000402010ULL, 0x0010084000402004ULL, 0x1800808020001002ULL, 0x0001010020100008ULL,
+	0x0800050011000800ULL, 0x0010080110042040ULL, 0x0100840042081001ULL, 0x0001020000B04401ULL,
+	0x0880400080008028ULL, 0x2040004080200080ULL, 0x0042004600118420ULL, 0x2100100080080082ULL,
+	0x2028040080080081ULL, 0x0044000480020080ULL, 0x10000804003AA110ULL, 0x580020420011008CULL,
+	0x0800408001002100ULL, 0x0000201000400048ULL, 0x4001002001004014ULL, 0x0004080184801000ULL,
+	0x4008004004040020ULL, 0x0C40800200800400ULL, 0x0008100204000108ULL, 0x700811A04200010CULL,
+	0x0002400021948004ULL, 0x0200208102020048ULL, 0x0020001421010040ULL, 0x0010210010010008ULL,
+	0x0804080004008080ULL, 0x0000040002008080ULL, 0x4082040200010100ULL, 0x0400610040920004ULL,
+	0xA100400080042480ULL, 0x0842400121118100ULL, 0x0008204082001200ULL, 0x0000800800100480ULL,
+	0x040C880100851100ULL, 0x1044020080040080ULL, 0x8092800200010080ULL, 0x800008804C010200ULL,
+	0x0280104020800103ULL, 0x0C210A0080102042ULL, 0x0000082200408012ULL, 0x5020900021000589ULL,
+	0x0032001008A00482ULL, 0x0042000804100102ULL, 0x0620102208890804ULL, 0x0280010044013682ULL,
+};
+static const Bitboard bishop_magic_numbers[64] =
+{
+	0x4009020800410202ULL, 0x4002040526260000ULL, 0x4110440480204708ULL, 0x08822A0201000100ULL,
+	0x08040504158A022CULL, 0x04D2022320800020ULL, 0x0007140202400080ULL, 0x0410110082104028ULL,
+	0xC020080204080220ULL, 0x0014A0011443004AULL, 0x8000044102020C10ULL, 0x0000080604400401ULL,
+	0x18015A02112A0000ULL, 0x1220010120100002ULL, 0x0008040084042010ULL, 0x5083410841042001ULL,
+	0x41200090041010C4ULL, 0x0010080842108420ULL, 0x80108008022402A1ULL, 0x000C0C4A01220100ULL,
+	0x280C000206110408ULL, 0x0842000300822522ULL, 0x0408402104100400ULL, 0x08814C8184008830ULL,
+	0x0208080084600800ULL, 0x42022000282800A4ULL, 0x2804040002002C00ULL, 0xE004080089010500ULL,
+	0x0484840031802000ULL, 0x0010004206080A10ULL, 0x80008C0009044220ULL, 0x8010684002060204ULL,
+	0x00080A4880C05800ULL, 0x0008020800020810ULL, 0x1000441000220020ULL, 0x1022010042040040ULL,
+	0x2004080200D92008ULL, 0x0182080204044040ULL, 0x2601010204211810ULL, 0x1400840108008080ULL,
+	0x00F40202102140D8ULL, 0x010880A808482002ULL, 0x4001004050010840ULL, 0x3000002011112804ULL,
+	0x0010A00C14002842ULL, 0x0040009880808104ULL, 0x0011250825034080ULL, 0x0922042404843A24ULL,
+	0x0082080484040000ULL, 0x4001420A05200300ULL, 0x0100008400884200ULL, 0x0411800284110000ULL,
+	0x0100002020410112ULL, 0x4000202042008000ULL, 0x0040040104051441ULL, 0x0408022084010080ULL,
+	0x2400820910824000ULL, 0x4110010088048200ULL, 0x8860000100411000ULL, 0x005000810020A802ULL,
+	0x616000C008103400ULL, 0xA040020A10210200ULL, 0x0402C82084040060ULL, 0x0002020204040680ULL,
+};
+
+// Sliding attacks for a piece on square given the occupied squares
+static inline Bitboard RookAttacks(int square, Bitboard blockers)
+{
+	const Magic &m = rook_magics[square];
+	return m.attacks[((blockers & m.mask) * m.magic) >> m.shift];
+}
+
+static inline Bitboard BishopAttacks(int square, Bitboard blockers)
+{
+	const Magic &m = bishop_magics[square];
+	return m.attacks[((blockers & m.mask) * m.magic) >> m.shift];
+}
+
 /****************************************************************************
- * Name:        Chess
+ * Name:        StepAttacks
+ * Input:       square - int
+ *				offsets - list of (dx, dy) steps
+ *				count - number of steps in the list
+ * Output:      None
+ * Returns:     Bitboard
+ * Description: Builds the set of squares a single step away from square in
+ *				each of the given directions, dropping steps off the board.
+ * Invokes:     None
+ * Note:        Used to fill in the knight, king and pawn tables.
+ ***************************************************************************/
+static Bitboard StepAttacks(int square, const int offsets[][2], int count)
+{
+	Bitboard attacks = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int x = SQUARE_X(square) + offsets[i][0];
+		int y = SQUARE_Y(square) + offsets[i][1];
+
+		if (x >= 0 && x < 8 && y >= 0 && y < 8)
+			attacks |= SQUARE_BIT(SQUARE(x, y));
+	}
+
+	return attacks;
+}
+
+/****************************************************************************
+ * Name:        SlidingAttacks
+ * Input:       square - int
+ *				blockers - bitboard of occupied squares
+ *				directions - the four directions the piece slides in
+ * Output:      None
+ * Returns:     Bitboard
+ * Description: Walks out from square along each direction until it runs off
+ *				the board or hits a blocker.  The blocking square is included
+ *				so that captures show up in the result.
+ * Invokes:     None
+ * Note:        This is the slow reference version, only used to build the
+ *				magic lookup tables.
+ ***************************************************************************/
+static Bitboard SlidingAttacks(int square, Bitboard blockers, const int directions[4][2])
+{
+	Bitboard attacks = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		int x = SQUARE_X(square) + directions[i][0];
+		int y = SQUARE_Y(square) + directions[i][1];
+
+		while (x >= 0 && x < 8 && y >= 0 && y < 8)
+		{
+			attacks |= SQUARE_BIT(SQUARE(x, y));
+
+			if (blockers & SQUARE_BIT(SQUARE(x, y)))
+				break;
+
+			x += directions[i][0];
+			y += directions[i][1];
+		}
+	}
+
+	return attacks;
+}
+
+/****************************************************************************
+ * Name:        InitMagics
+ * Input:       magics - the table of magics to fill in (rook or bishop)
+ *				numbers - the magic number for each square
+ *				table - storage for the attack sets
+ *				directions - the four directions the piece slides in
+ * Output:      None
+ * Returns:     None
+ * Description: Fills in the attack sets for every square.  Each subset of
+ *				the relevant blockers is enumerated, its attack set worked out
+ *				the slow way, and stored in the slot its magic index picks.
+ * Invokes:     SlidingAttacks()
+ * Note:        None
+ ***************************************************************************/
+static void InitMagics(Magic *magics, const Bitboard *numbers, Bitboard *table, const int directions[4][2])
+{
+	// Blockers on the edge of the board never change the attack set
+	const Bitboard rows_edge = 0xFF000000000000FFULL;
+	const Bitboard columns_edge = 0x8181818181818181ULL;
+
+	for (int s = 0; s < 64; s++)
+	{
+		Magic &m = magics[s];
+
+		Bitboard edges = (rows_edge & ~(0xFFULL << (SQUARE_Y(s) * 8))) |
+						 (columns_edge & ~(0x0101010101010101ULL << SQUARE_X(s)));
+
+		m.mask = SlidingAttacks(s, 0, directions) & ~edges;
+		m.magic = numbers[s];
+		m.shift = 64 - PopCount(m.mask);
+		m.attacks = table;
+
+		// Walk every subset of the mask (the "carry-rippler" trick)
+		Bitboard b = 0;
+
+		do
+		{
+			m.attacks[((b & m.mask) * m.magic) >> m.shift] = SlidingAttacks(s, b, directions);
+			b = (b - m.mask) & m.mask;
+		} while (b);
+
+		table += (Bitboard)1 << (64 - m.shift);
+	}
+}
+
+/****************************************************************************
+ * Name:        InitLines
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Fills in the between and lines tables for every pair of
+ *				squares a rook or bishop could slide between.
+ * Invokes:     SlidingAttacks()
+ * Note:        None
+ ***************************************************************************/
+static void InitLines()
+{
+	for (int a = 0; a < 64; a++)
+	{
+		for (int b = 0; b < 64; b++)
+		{
+			between[a][b] = 0;
+			lines[a][b] = 0;
+
+			if (a == b)
+				continue;
+
+			const int (*directions)[2] = 0;
+
+			if (SlidingAttacks(a, 0, rook_directions) & SQUARE_BIT(b))
+				directions = rook_directions;
+			else if (SlidingAttacks(a, 0, bishop_directions) & SQUARE_BIT(b))
+				directions = bishop_directions;
+			else
+				continue;
+
+			// Each square blocks the other's rays, so what both see is
+			// exactly the gap between them
+			between[a][b] = SlidingAttacks(a, SQUARE_BIT(b), directions) & SlidingAttacks(b, SQUARE_BIT(a), directions);
+			lines[a][b] = (SlidingAttacks(a, 0, directions) & SlidingAttacks(b, 0, directions)) | SQUARE_BIT(a) | SQUARE_BIT(b);
+		}
+	}
+}
+
+/****************************************************************************
+ * Name:        InitAttackTables
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Fills in the knight, king and pawn attack tables, the
+ *				magic lookups for the sliding pieces, and the lines between
+ *				squares.
+ * Invokes:     StepAttacks()
+ *				InitMagics()
+ *				InitLines()
+ * Note:        The tables only need to be built once, later calls return
+ *				right away.
+ ***************************************************************************/
+static void InitAttackTables()
+{
+	static bool initialized = false;
+
+	static const int knight_offsets[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2},
+											  {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+	static const int king_offsets[8][2] = { {1, 0}, {1, 1}, {0, 1}, {-1, 1},
+											{-1, 0}, {-1, -1}, {0, -1}, {1, -1} };
+	static const int white_pawn_offsets[2][2] = { {-1, -1}, {1, -1} };
+	static const int black_pawn_offsets[2][2] = { {-1, 1}, {1, 1} };
+
+	if (initialized)
+		return;
+
+	for (int s = 0; s < 64; s++)
+	{
+		knight_attacks[s] = StepAttacks(s, knight_offsets, 8);
+		king_attacks[s] = StepAttacks(s, king_offsets, 8);
+		pawn_attacks[PLAYER_WHITE][s] = StepAttacks(s, white_pawn_offsets, 2);
+		pawn_attacks[PLAYER_BLACK][s] = StepAttacks(s, black_pawn_offsets, 2);
+	}
+
+	InitMagics(rook_magics, rook_magic_numbers, rook_table, rook_directions);
+	InitMagics(bishop_magics, bishop_magic_numbers, bishop_table, bishop_directions);
+
+	InitLines();
+
+	initialized = true;
+}
+
+/****************************************************************************
+ * Name:        InitHashKeys
  * Input:       None
  * Output:      None
  * Returns:     None
- * Description: Default constructor, just used as a placeholder.
+ * Description: Fills in the Zobrist keys with numbers from a xorshift
+ *				generator.
  * Invokes:     None
+ * Note:        The seed is fixed so a position has the same key every time
+ *				the game is run.
+ ***************************************************************************/
+static void InitHashKeys()
+{
+	static bool initialized = false;
+
+	if (initialized)
+		return;
+
+	HashKey x = 0x9E3779B97F4A7C15ULL;
+
+	for (int p = 0; p <= KING_BLACK; p++)
+	{
+		for (int s = 0; s < 64; s++)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+
+			// Empty squares and unused piece codes add nothing to the key
+			piece_keys[p][s] = (p == EMPTY ? 0 : x);
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		castle_keys[i] = x;
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		enpassant_keys[i] = x;
+	}
+
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	turn_key = x;
+
+	initialized = true;
+}
+
+/****************************************************************************
+ * Name:        Chess
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Default constructor, makes sure the attack tables and hash
+ *				keys are built.
+ * Invokes:     InitAttackTables()
+ *				InitHashKeys()
  * Note:        None
  ***************************************************************************/
 Chess::Chess()
 {
-
+	InitAttackTables();
+	InitHashKeys();
 }
 
 /****************************************************************************
@@ -66,33 +411,31 @@ void Chess::Init()
 	num_players = 1;
 
 	// Initial piece positions
-	for (int x = 0; x < 8; x++)
-		for (int y = 2; y < 6; y++)
-			board[x][y] = EMPTY;
-
-	board[0][0] = ROOK_BLACK;
-	board[1][0] = KNIGHT_BLACK;
-	board[2][0] = BISHOP_BLACK;
-	board[3][0] = QUEEN_BLACK;
-	board[4][0] = KING_BLACK;
-	board[5][0] = BISHOP_BLACK;
-	board[6][0] = KNIGHT_BLACK;
-	board[7][0] = ROOK_BLACK;
-
-	board[0][7] = ROOK_WHITE;
-	board[1][7] = KNIGHT_WHITE;
-	board[2][7] = BISHOP_WHITE;
-	board[3][7] = QUEEN_WHITE;
-	board[4][7] = KING_WHITE;
-	board[5][7] = BISHOP_WHITE;
-	board[6][7] = KNIGHT_WHITE;
-	board[7][7] = ROOK_WHITE;
+	ClearBoard();
+
+	PutPiece(ROOK_BLACK, SQUARE(0, 0));
+	PutPiece(KNIGHT_BLACK, SQUARE(1, 0));
+	PutPiece(BISHOP_BLACK, SQUARE(2, 0));
+	PutPiece(QUEEN_BLACK, SQUARE(3, 0));
+	PutPiece(KING_BLACK, SQUARE(4, 0));
+	PutPiece(BISHOP_BLACK, SQUARE(5, 0));
+	PutPiece(KNIGHT_BLACK, SQUARE(6, 0));
+	PutPiece(ROOK_BLACK, SQUARE(7, 0));
+
+	PutPiece(ROOK_WHITE, SQUARE(0, 7));
+	PutPiece(KNIGHT_WHITE, SQUARE(1, 7));
+	PutPiece(BISHOP_WHITE, SQUARE(2, 7));
+	PutPiece(QUEEN_WHITE, SQUARE(3, 7));
+	PutPiece(KING_WHITE, SQUARE(4, 7));
+	PutPiece(BISHOP_WHITE, SQUARE(5, 7));
+	PutPiece(KNIGHT_WHITE, SQUARE(6, 7));
+	PutPiece(ROOK_WHITE, SQUARE(7, 7));
 
 	for (int i = 0; i < 8; i++)
-		board[i][1] = PAWN_BLACK;
+		PutPiece(PAWN_BLACK, SQUARE(i, 1));
 
 	for (int j = 0; j < 8; j++)
-		board[j][6] = PAWN_WHITE;
+		PutPiece(PAWN_WHITE, SQUARE(j, 6));
 
 	// Castling is set to available
 	WhiteCastleLeft = true;
@@ -100,104 +443,844 @@ void Chess::Init()
 	BlackCastleLeft = true;
 	BlackCastleRight = true;
 
-	num_pieces = 32;
+	hash ^= CastleHash();
+
+	undo_count = 0;
+	history_count = 0;
+	halfmove_clock = 0;
+	fullmove_number = 1;
+}
+
+/****************************************************************************
+ * Name:        LoadFEN
+ * Input:       fen - string in Forsyth-Edwards Notation
+ * Output:      None
+ * Returns:     true if the position was set up, false if the string is bad
+ * Description: Sets up the board, the player to move, the castling flags,
+ *				the en passant column and the move clocks from a FEN string,
+ *				such as
+ *				"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1".
+ * Invokes:     SetPosition()
+ * Note:        The two clocks may be left off, as they often are.
+ ***************************************************************************/
+bool Chess::LoadFEN(const std::string &fen)
+{
+	std::istringstream ss(fen);
+	std::string board, side, castling, enpassant;
+	int halfmoves = 0, fullmoves = 1;
+
+	ss >> board >> side >> castling >> enpassant;
+
+	if (!(ss >> halfmoves >> fullmoves))
+	{
+		halfmoves = 0;
+		fullmoves = 1;
+	}
+
+	return SetPosition(board, side, castling, enpassant, halfmoves, fullmoves);
+}
+
+/****************************************************************************
+ * Name:        GetFEN
+ * Input:       None
+ * Output:      None
+ * Returns:     the current position in Forsyth-Edwards Notation
+ * Description: The inverse of LoadFEN(), clocks included.
+ * Invokes:     PositionFields()
+ * Note:        None
+ ***************************************************************************/
+std::string Chess::GetFEN()
+{
+	std::ostringstream ss;
+
+	ss << PositionFields() << " " << halfmove_clock << " " << fullmove_number;
+
+	return ss.str();
+}
+
+/****************************************************************************
+ * Name:        LoadEPD
+ * Input:       epd - an EPD line
+ *				opcodes - filled in with the line's operations
+ * Output:      None
+ * Returns:     true if the position was set up, false if the line is bad
+ * Description: EPD is FEN without the clocks, followed by any number of
+ *				operations like
+ *				bm Nf3; id "WAC.001";
+ *				Each opcode is mapped to the rest of its operation, kept
+ *				exactly as written (quotes and all).  The "hmvc" and "fmvn"
+ *				opcodes, if there, set the clocks.
+ * Invokes:     SetPosition()
+ * Note:        A semicolon inside quotes doesn't end the operation.
+ ***************************************************************************/
+bool Chess::LoadEPD(const std::string &epd, std::map<std::string, std::string> &opcodes)
+{
+	std::istringstream ss(epd);
+	std::string board, side, castling, enpassant, rest;
+
+	ss >> board >> side >> castling >> enpassant;
+	std::getline(ss, rest);
+
+	opcodes.clear();
+
+	// Split the operations on the semicolons that aren't quoted
+	std::string operation;
+	bool quoted = false;
+
+	for (size_t i = 0; i <= rest.size(); i++)
+	{
+		char c = (i < rest.size() ? rest[i] : ';');
+
+		if (c == '"')
+			quoted = !quoted;
+
+		if (c != ';' || quoted)
+		{
+			operation += c;
+			continue;
+		}
+
+		std::istringstream op(operation);
+		std::string opcode, operand;
+
+		if (op >> opcode)
+		{
+			std::getline(op >> std::ws, operand);
+			opcodes[opcode] = operand;
+		}
+
+		operation.clear();
+	}
+
+	int halfmoves = 0, fullmoves = 1;
+
+	if (opcodes.count("hmvc"))
+		halfmoves = atoi(opcodes["hmvc"].c_str());
+
+	if (opcodes.count("fmvn"))
+		fullmoves = atoi(opcodes["fmvn"].c_str());
+
+	return SetPosition(board, side, castling, enpassant, halfmoves, fullmoves);
+}
+
+/****************************************************************************
+ * Name:        GetEPD
+ * Input:       opcodes - the operations to add after the position
+ * Output:      None
+ * Returns:     the current position as an EPD line
+ * Description: The inverse of LoadEPD() - the position fields, then each
+ *				opcode and its operand followed by a semicolon.
+ * Invokes:     PositionFields()
+ * Note:        Operands are written as given, so string operands need their
+ *				own quotes.  The clocks only appear if passed as "hmvc" and
+ *				"fmvn".
+ ***************************************************************************/
+std::string Chess::GetEPD(const std::map<std::string, std::string> &opcodes)
+{
+	std::string epd = PositionFields();
+
+	for (std::map<std::string, std::string>::const_iterator it = opcodes.begin(); it != opcodes.end(); ++it)
+	{
+		epd += " " + it->first;
+
+		if (!it->second.empty())
+			epd += " " + it->second;
+
+		epd += ";";
+	}
+
+	return epd;
+}
+
+/****************************************************************************
+ * Name:        SetPosition
+ * Input:       board - the piece placement field
+ *				side - "w" or "b"
+ *				castling - the castling field, such as "KQkq" or "-"
+ *				enpassant - the en passant square, such as "e3" or "-"
+ *				halfmoves - halfmoves since the last capture or pawn move
+ *				fullmoves - the move number
+ * Output:      None
+ * Returns:     true if the position was set up, false if a field is bad or
+ *				the position can't come up in a game
+ * Description: Does the real work of LoadFEN() and LoadEPD().  Besides the
+ *				syntax, it checks that each side has one king, no pawn is
+ *				on the first or last row, the player who just moved isn't
+ *				left in check, and an en passant square is one a pawn just
+ *				skipped over.
+ * Invokes:     ClearBoard()
+ *				PutPiece()
+ *				CastleHash()
+ *				InCheck()
+ *				Classify()
+ * Note:        The rows are listed from black's side of the board, which is
+ *				y = 0 here, so they fill in the same order as squares[].  The
+ *				game history starts fresh.  Bad fields leave the current
+ *				position alone.
+ ***************************************************************************/
+bool Chess::SetPosition(const std::string &board, const std::string &side, const std::string &castling,
+						const std::string &enpassant, int halfmoves, int fullmoves)
+{
+	static const std::string white_letters = "PRNBQK";
+	static const std::string black_letters = "prnbqk";
+
+	if (board.empty() || (side != "w" && side != "b"))
+		return false;
+
+	// Read the pieces into a scratch board first, so a mistake part way
+	// through doesn't wreck the game in progress
+	int layout[64];
+	int x = 0, y = 0;
+
+	for (int s = 0; s < 64; s++)
+		layout[s] = EMPTY;
+
+	for (size_t i = 0; i < board.size(); i++)
+	{
+		char c = board[i];
+
+		if (c == '/')
+		{
+			if (x != 8)
+				return false;
+
+			x = 0;
+			y++;
+		}
+
+		else if (c >= '1' && c <= '8')
+			x += c - '0';
+
+		else if (white_letters.find(c) != std::string::npos && x < 8 && y < 8)
+			layout[SQUARE(x++, y)] = PAWN_WHITE + (int)white_letters.find(c);
+
+		else if (black_letters.find(c) != std::string::npos && x < 8 && y < 8)
+			layout[SQUARE(x++, y)] = PAWN_BLACK + (int)black_letters.find(c);
+
+		else
+			return false;
+
+		if (x > 8)
+			return false;
+	}
+
+	if (x != 8 || y != 7)
+		return false;
+
+	// Each side needs exactly one king
+	int kings = 0;
+
+	for (int s = 0; s < 64; s++)
+	{
+		if (layout[s] == KING_WHITE)
+			kings += 1;
+		else if (layout[s] == KING_BLACK)
+			kings += 10;
+	}
+
+	if (kings != 11)
+		return false;
+
+	// Pawns promote on the last row and never go back to the first
+	for (int s = 0; s < 8; s++)
+	{
+		if (layout[s] == PAWN_WHITE || layout[s] == PAWN_BLACK ||
+			layout[s + 56] == PAWN_WHITE || layout[s + 56] == PAWN_BLACK)
+			return false;
+	}
+
+	// An en passant square is on the row just behind a pawn of the player
+	// who just moved, which came from two rows back - rank 6 if white is to
+	// move, rank 3 if black is (rank r is y = 8 - r)
+	int ep_x = -1;
+
+	if (enpassant != "-")
+	{
+		bool white = (side == "w");
+
+		if (enpassant.size() != 2 || enpassant[0] < 'a' || enpassant[0] > 'h' ||
+			enpassant[1] != (white ? '6' : '3'))
+			return false;
+
+		ep_x = enpassant[0] - 'a';
+
+		int skipped = SQUARE(ep_x, white ? 2 : 5);
+		int pawn = SQUARE(ep_x, white ? 3 : 4);
+		int from = SQUARE(ep_x, white ? 1 : 6);
+
+		if (layout[pawn] != (white ? PAWN_BLACK : PAWN_WHITE) ||
+			layout[skipped] != EMPTY || layout[from] != EMPTY)
+			return false;
+	}
+
+	// The rest needs the attack tables, so set the position up on the real
+	// board, keeping the old one in case the player who just moved turns
+	// out to be in check
+	Chess saved = *this;
+
+	ClearBoard();
+
+	for (int s = 0; s < 64; s++)
+		PutPiece(layout[s], s);
+
+	turn = (side == "w" ? PLAYER_WHITE : PLAYER_BLACK);
+
+	WhiteCastleLeft = (castling.find('Q') != std::string::npos);
+	WhiteCastleRight = (castling.find('K') != std::string::npos);
+	BlackCastleLeft = (castling.find('q') != std::string::npos);
+	BlackCastleRight = (castling.find('k') != std::string::npos);
+
+	hash ^= CastleHash();
+
+	// Only the column matters, the row always follows from whose turn it is.
+	// As after a move, it is only kept if a pawn of the player to move can
+	// take en passant.
+	if (ep_x >= 0 && PawnBeside(ep_x, (turn == PLAYER_WHITE ? 3 : 4), turn == PLAYER_WHITE ? PAWN_WHITE : PAWN_BLACK))
+	{
+		enpassant_x = ep_x;
+		hash ^= enpassant_keys[enpassant_x];
+	}
+
+	if (turn == PLAYER_BLACK)
+		hash ^= turn_key;
+
+	// The player to move could just take the king
+	if (InCheck(turn == PLAYER_WHITE ? PLAYER_BLACK : PLAYER_WHITE))
+	{
+		*this = saved;
+		return false;
+	}
+
+	num_players = 1;
+	undo_count = 0;
+	history_count = 0;
+	halfmove_clock = (halfmoves > 0 ? halfmoves : 0);
+	fullmove_number = (fullmoves > 0 ? fullmoves : 1);
+
+	game_state = Classify(turn);
+
+	return true;
+}
+
+/****************************************************************************
+ * Name:        PositionFields
+ * Input:       None
+ * Output:      None
+ * Returns:     the first four fields of FEN and EPD
+ * Description: Writes out the pieces row by row from black's side, counting
+ *				runs of empty squares, then the player to move, the castling
+ *				flags and the en passant square.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+std::string Chess::PositionFields()
+{
+	static const char letters[] = " PRNBQK    prnbqk";
+	std::string fields;
+
+	for (int y = 0; y < 8; y++)
+	{
+		int empty = 0;
+
+		for (int x = 0; x < 8; x++)
+		{
+			int piece = squares[SQUARE(x, y)];
+
+			if (piece == EMPTY)
+			{
+				empty++;
+				continue;
+			}
+
+			if (empty)
+				fields += (char)('0' + empty);
+
+			fields += letters[piece];
+			empty = 0;
+		}
+
+		if (empty)
+			fields += (char)('0' + empty);
+
+		if (y < 7)
+			fields += '/';
+	}
+
+	fields += (turn == PLAYER_WHITE ? " w " : " b ");
+
+	if (WhiteCastleRight) fields += 'K';
+	if (WhiteCastleLeft) fields += 'Q';
+	if (BlackCastleRight) fields += 'k';
+	if (BlackCastleLeft) fields += 'q';
+
+	if (!WhiteCastleRight && !WhiteCastleLeft && !BlackCastleRight && !BlackCastleLeft)
+		fields += '-';
+
+	// The square the pawn skipped over - behind it from the mover's side
+	if (enpassant_x >= 0)
+	{
+		fields += ' ';
+		fields += (char)('a' + enpassant_x);
+		fields += (turn == PLAYER_WHITE ? '6' : '3');
+	}
+
+	else
+		fields += " -";
+
+	return fields;
+}
+
+/****************************************************************************
+ * Name:        ClearBoard
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Empties every square and every bitboard.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+void Chess::ClearBoard()
+{
+	for (int p = 0; p <= KING_BLACK; p++)
+		pieces[p] = 0;
+
+	occupancy[PLAYER_WHITE] = 0;
+	occupancy[PLAYER_BLACK] = 0;
+	occupied = 0;
+
+	for (int s = 0; s < 64; s++)
+		squares[s] = EMPTY;
+
+	enpassant_x = -1;
+	hash = 0;
+}
+
+/****************************************************************************
+ * Name:        PutPiece
+ * Input:       piece - int
+ *				square - int
+ * Output:      None
+ * Returns:     None
+ * Description: Places a piece on an empty square and sets its bit in the
+ *				piece, player and occupancy bitboards.
+ * Invokes:     WhitePiece()
+ * Note:        Every change to the board goes through PutPiece() and
+ *				RemovePiece() so the bitboards, squares[] and the hash never
+ *				disagree.
+ ***************************************************************************/
+void Chess::PutPiece(int piece, int square)
+{
+	if (piece == EMPTY)
+		return;
+
+	Bitboard bit = SQUARE_BIT(square);
+
+	pieces[piece] |= bit;
+	occupancy[WhitePiece(piece) ? PLAYER_WHITE : PLAYER_BLACK] |= bit;
+	occupied |= bit;
+
+	squares[square] = piece;
+	hash ^= piece_keys[piece][square];
+}
+
+/****************************************************************************
+ * Name:        RemovePiece
+ * Input:       square - int
+ * Output:      None
+ * Returns:     None
+ * Description: Takes the piece on the given square off the board, clearing
+ *				its bit in every bitboard.
+ * Invokes:     WhitePiece()
+ * Note:        Removing from an empty square does nothing.
+ ***************************************************************************/
+void Chess::RemovePiece(int square)
+{
+	int piece = squares[square];
+
+	if (piece == EMPTY)
+		return;
+
+	Bitboard bit = SQUARE_BIT(square);
+
+	pieces[piece] &= ~bit;
+	occupancy[WhitePiece(piece) ? PLAYER_WHITE : PLAYER_BLACK] &= ~bit;
+	occupied &= ~bit;
+
+	squares[square] = EMPTY;
+	hash ^= piece_keys[piece][square];
 }
 
 /****************************************************************************
  * Name:        GenerateMoves
  * Input:       move_list - array of moves
  *				player - int
+ *				first_only - stop after the first piece with a move
+ *				captures_only - leave out moves that don't capture or promote
  * Output:      None
  * Returns:     an integer indicating the number of available moves
  * Description: This function generates all of the moves possible for the
  *				given player and puts them into move_list
- * Invokes:     LegalMove()
- *				WhitePiece()
- *				BlackPiece()
- * Note:        All moves generated are legal moves except the special cases
- *				of moving into check or castling out of check.  These are
- *				handled elsewhere
+ * Invokes:     AddMoves()
+ *				AddPromotions()
+ *				Attackers()
+ * Note:        Every move generated is fully legal - none of them leave the
+ *				player's king in check, and castling out of or through check
+ *				is left out.  Rather than making each move to test it, the
+ *				pieces checking the king and the pieces pinned to it are found
+ *				up front.  In check, other pieces may only capture the checker
+ *				or block it (check_mask), and a pinned piece may only move
+ *				along the line of its pin.  The king itself just avoids
+ *				attacked squares.  With first_only set the list may stop
+ *				short, which is all that's needed to tell if any move exists.
+ *				With captures_only set only moves onto an enemy piece, en
+ *				passant and promotions are given, for the quiescence search.
  ***************************************************************************/
-int Chess::GenerateMoves(Move *move_list, int player)
+int Chess::GenerateMoves(Move *move_list, int player, bool first_only, bool captures_only)
 {
-	Move m;
 	int num = 0;
 
-	// Loop through every tile
-	for (int x1 = 0; x1 < 8; x1++)
+	int opponent = (player == PLAYER_WHITE ? PLAYER_BLACK : PLAYER_WHITE);
+
+	Bitboard own = occupancy[player];
+	Bitboard enemy = occupancy[opponent];
+
+	int pawn = (player == PLAYER_WHITE ? PAWN_WHITE : PAWN_BLACK);
+	int knight = (player == PLAYER_WHITE ? KNIGHT_WHITE : KNIGHT_BLACK);
+	int bishop = (player == PLAYER_WHITE ? BISHOP_WHITE : BISHOP_BLACK);
+	int rook = (player == PLAYER_WHITE ? ROOK_WHITE : ROOK_BLACK);
+	int queen = (player == PLAYER_WHITE ? QUEEN_WHITE : QUEEN_BLACK);
+	int king = (player == PLAYER_WHITE ? KING_WHITE : KING_BLACK);
+
+	// Pawns move up the board (towards y = 0) for white, down for black
+	int forward = (player == PLAYER_WHITE ? -8 : 8);
+	int start_row = (player == PLAYER_WHITE ? 6 : 1);
+	int last_row = (player == PLAYER_WHITE ? 0 : 7);
+
+	// Find the pieces giving check and the pieces pinned to the king
+	Bitboard checkers = 0;
+	Bitboard pinned = 0;
+	Bitboard check_mask = ~0ULL;
+	int king_square = (pieces[king] ? LowestSquare(pieces[king]) : -1);
+
+	if (king_square >= 0)
 	{
-		for (int y1 = 0; y1 < 8; y1++)
+		checkers = Attackers(king_square, opponent, occupied);
+
+		// A single checker can be captured or blocked, a double check
+		// can only be answered by moving the king
+		if (PopCount(checkers) == 1)
+			check_mask = checkers | between[king_square][LowestSquare(checkers)];
+		else if (checkers)
+			check_mask = 0;
+
+		// Enemy sliders lined up with the king pin our piece if it is the
+		// only thing in the way
+		int enemy_queen = (player == PLAYER_WHITE ? QUEEN_BLACK : QUEEN_WHITE);
+		Bitboard snipers = (RookAttacks(king_square, 0) & (pieces[rook == ROOK_WHITE ? ROOK_BLACK : ROOK_WHITE] | pieces[enemy_queen])) |
+						   (BishopAttacks(king_square, 0) & (pieces[bishop == BISHOP_WHITE ? BISHOP_BLACK : BISHOP_WHITE] | pieces[enemy_queen]));
+
+		while (snipers)
 		{
-			// Can't be a move starting at an empty piece
-			if (board[x1][y1] == EMPTY)
-				continue;
+			Bitboard blockers = between[king_square][PopLowestSquare(snipers)] & occupied;
 
-			// If the piece belongs to the wrong player, it's an illegal move
-			if (player == PLAYER_WHITE && !WhitePiece(board[x1][y1]))
-				continue;
+			if (PopCount(blockers) == 1)
+				pinned |= blockers & own;
+		}
+	}
 
-			if (player == PLAYER_BLACK && !BlackPiece(board[x1][y1]))
-				continue;
+	// Everywhere a piece other than the king may go
+	Bitboard targets = ~own & check_mask;
 
-			// Legal piece, try to move to every possible tile
-			for (int x2 = 0; x2 < 8; x2++)
-			{
-				for (int y2 = 0; y2 < 8; y2++)
-				{
-					// Not moving isn't a legal move
-					if (x1 == x2 && y1 == y2)
-						continue;
+	if (captures_only)
+		targets &= enemy;
 
-					// Fill out a move structure and pass it to LegalMove()
-					m.oldx = x1;
-					m.oldy = y1;
-					m.newx = x2;
-					m.newy = y2;
+	Bitboard b = pieces[pawn];
 
-					m.piece = board[x1][y1];
-					m.captured = board[x2][y2];
+	while (b)
+	{
+		int from = PopLowestSquare(b);
 
-					if (LegalMove(&m))
-					{
-						// The move is legal, add it to the list
-						move_list[num] = m;
-						num++;
-					}
-				}
-			}
+		// One step forward onto an empty square, two from the initial position
+		int to = from + forward;
+		Bitboard steps = 0;
+
+		if (!(occupied & SQUARE_BIT(to)))
+		{
+			steps = SQUARE_BIT(to);
+
+			if (SQUARE_Y(from) == start_row && !(occupied & SQUARE_BIT(to + forward)))
+				steps |= SQUARE_BIT(to + forward);
+		}
+
+		// Only a step that promotes counts with the captures
+		if (captures_only && SQUARE_Y(to) != last_row)
+			steps = 0;
+
+		// Diagonal steps only when there is something to capture
+		steps |= pawn_attacks[player][from] & enemy;
+
+		steps &= check_mask;
+
+		if (pinned & SQUARE_BIT(from))
+			steps &= lines[king_square][from];
+
+		if (SQUARE_Y(to) == last_row)
+			AddPromotions(move_list, num, from, steps);
+		else
+			AddMoves(move_list, num, from, steps);
+
+		if (first_only && num)
+			return num;
+	}
+
+	// Special case - enpassant, only right after an enemy pawn moves two spaces
+	int passed = (enpassant_x >= 0 ? SQUARE(enpassant_x, start_row + 3 * forward / 8) : 0);
+
+	if (enpassant_x >= 0 && squares[passed] == (player == PLAYER_WHITE ? PAWN_BLACK : PAWN_WHITE))
+	{
+		int to = passed + forward;
+
+		// Our pawns that could capture onto the skipped square are the ones
+		// an enemy pawn standing on that square would attack
+		b = pieces[pawn] & pawn_attacks[opponent][to];
+
+		while (b && squares[to] == EMPTY)
+		{
+			int from = PopLowestSquare(b);
+
+			// Two pawns leave the row at once, which the pin and check
+			// masks can't account for, so look at the king directly
+			Bitboard after = (occupied ^ SQUARE_BIT(from) ^ SQUARE_BIT(passed)) | SQUARE_BIT(to);
+
+			if (king_square < 0 || !(Attackers(king_square, opponent, after) & ~SQUARE_BIT(passed)))
+				move_list[num++] = Move(from, to, MOVE_ENPASSANT);
+		}
+
+		if (first_only && num)
+			return num;
+	}
+
+	// A pinned knight can never stay on the line of its pin
+	b = pieces[knight] & ~pinned;
+
+	while (b)
+	{
+		int from = PopLowestSquare(b);
+		AddMoves(move_list, num, from, knight_attacks[from] & targets);
+
+		if (first_only && num)
+			return num;
+	}
+
+	b = pieces[bishop] | pieces[queen];
+
+	while (b)
+	{
+		int from = PopLowestSquare(b);
+		Bitboard steps = BishopAttacks(from, occupied) & targets;
+
+		if (pinned & SQUARE_BIT(from))
+			steps &= lines[king_square][from];
+
+		AddMoves(move_list, num, from, steps);
+
+		if (first_only && num)
+			return num;
+	}
+
+	b = pieces[rook] | pieces[queen];
+
+	while (b)
+	{
+		int from = PopLowestSquare(b);
+		Bitboard steps = RookAttacks(from, occupied) & targets;
+
+		if (pinned & SQUARE_BIT(from))
+			steps &= lines[king_square][from];
+
+		AddMoves(move_list, num, from, steps);
+
+		if (first_only && num)
+			return num;
+	}
+
+	if (king_square < 0)
+		return num;
+
+	// The king can go anywhere not attacked - taking it off the board first
+	// so it can't hide behind itself from a slider
+	b = king_attacks[king_square] & ~own;
+
+	if (captures_only)
+		b &= enemy;
+
+	while (b)
+	{
+		int to = PopLowestSquare(b);
+
+		if (!Attackers(to, opponent, occupied ^ SQUARE_BIT(king_square)))
+			move_list[num++] = Move(king_square, to);
+	}
+
+	if ((first_only && num) || captures_only)
+		return num;
+
+	// Castling, with the same requirements LegalMove() checks, plus the
+	// king may not castle out of check or pass over an attacked square
+	int home = (player == PLAYER_WHITE ? 7 : 0);
+	bool castle_left = (player == PLAYER_WHITE ? WhiteCastleLeft : BlackCastleLeft);
+	bool castle_right = (player == PLAYER_WHITE ? WhiteCastleRight : BlackCastleRight);
+
+	if (king_square == SQUARE(4, home) && !checkers)
+	{
+		if (castle_left && squares[SQUARE(0, home)] == rook &&
+			!(occupied & (SQUARE_BIT(SQUARE(1, home)) | SQUARE_BIT(SQUARE(2, home)) | SQUARE_BIT(SQUARE(3, home)))) &&
+			!SquareAttacked(SQUARE(3, home), opponent) && !SquareAttacked(SQUARE(2, home), opponent))
+		{
+			move_list[num++] = Move(SQUARE(4, home), SQUARE(2, home), MOVE_CASTLE);
+		}
+
+		if (castle_right && squares[SQUARE(7, home)] == rook &&
+			!(occupied & (SQUARE_BIT(SQUARE(5, home)) | SQUARE_BIT(SQUARE(6, home)))) &&
+			!SquareAttacked(SQUARE(5, home), opponent) && !SquareAttacked(SQUARE(6, home), opponent))
+		{
+			move_list[num++] = Move(SQUARE(4, home), SQUARE(6, home), MOVE_CASTLE);
 		}
 	}
 
 	return num;
 }
 
+/****************************************************************************
+ * Name:        AddMoves
+ * Input:       move_list - array of moves
+ *				num - number of moves in the list (passed by reference)
+ *				from - square the moving piece is on
+ *				targets - bitboard of destination squares
+ * Output:      None
+ * Returns:     None
+ * Description: Appends one plain move to move_list for every square set in
+ *				targets.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+void Chess::AddMoves(Move *move_list, int &num, int from, Bitboard targets)
+{
+	while (targets)
+		move_list[num++] = Move(from, PopLowestSquare(targets));
+}
+
+/****************************************************************************
+ * Name:        AddPromotions
+ * Input:       move_list - array of moves
+ *				num - number of moves in the list (passed by reference)
+ *				from - square the pawn is on
+ *				targets - bitboard of destination squares
+ * Output:      None
+ * Returns:     None
+ * Description: Appends a promotion to a queen, rook, bishop and knight for
+ *				every square set in targets.
+ * Invokes:     None
+ * Note:        The queen comes first since it is almost always the best.
+ ***************************************************************************/
+void Chess::AddPromotions(Move *move_list, int &num, int from, Bitboard targets)
+{
+	while (targets)
+	{
+		int to = PopLowestSquare(targets);
+
+		move_list[num++] = Move(from, to, MOVE_PROMOTION, QUEEN_WHITE);
+		move_list[num++] = Move(from, to, MOVE_PROMOTION, ROOK_WHITE);
+		move_list[num++] = Move(from, to, MOVE_PROMOTION, BISHOP_WHITE);
+		move_list[num++] = Move(from, to, MOVE_PROMOTION, KNIGHT_WHITE);
+	}
+}
+
+/****************************************************************************
+ * Name:        SquareAttacked
+ * Input:       square - int (see SQUARE())
+ *				player - int
+ * Output:      None
+ * Returns:     bool
+ * Description: Returns true if any of player's pieces attacks the square.
+ * Invokes:     RookAttacks()
+ *				BishopAttacks()
+ * Note:        Rather than generating the attacker's moves, this looks
+ *				outward from the square itself.  A knight on the square would
+ *				attack exactly the squares a knight could attack it from, and
+ *				likewise for kings, sliders, and (with the colors swapped)
+ *				pawns.
+ ***************************************************************************/
+bool Chess::SquareAttacked(int square, int player)
+{
+	bool white = (player == PLAYER_WHITE);
+
+	if (knight_attacks[square] & pieces[white ? KNIGHT_WHITE : KNIGHT_BLACK])
+		return true;
+
+	if (king_attacks[square] & pieces[white ? KING_WHITE : KING_BLACK])
+		return true;
+
+	if (pawn_attacks[white ? PLAYER_BLACK : PLAYER_WHITE][square] & pieces[white ? PAWN_WHITE : PAWN_BLACK])
+		return true;
+
+	Bitboard queens = pieces[white ? QUEEN_WHITE : QUEEN_BLACK];
+
+	if (BishopAttacks(square, occupied) & (pieces[white ? BISHOP_WHITE : BISHOP_BLACK] | queens))
+		return true;
+
+	if (RookAttacks(square, occupied) & (pieces[white ? ROOK_WHITE : ROOK_BLACK] | queens))
+		return true;
+
+	return false;
+}
+
+/****************************************************************************
+ * Name:        Attackers
+ * Input:       square - int (see SQUARE())
+ *				player - int
+ *				blockers - bitboard of the squares that block sliders
+ * Output:      None
+ * Returns:     Bitboard
+ * Description: Returns every one of player's pieces that attacks the square,
+ *				with the sliders blocked only by the given squares.
+ * Invokes:     RookAttacks()
+ *				BishopAttacks()
+ * Note:        Works the same way as SquareAttacked(), but finds them all.
+ *				Passing something other than the real occupancy lets the
+ *				move generator ask what would be attacked once a piece moves.
+ ***************************************************************************/
+Bitboard Chess::Attackers(int square, int player, Bitboard blockers)
+{
+	bool white = (player == PLAYER_WHITE);
+	Bitboard queens = pieces[white ? QUEEN_WHITE : QUEEN_BLACK];
+
+	return (knight_attacks[square] & pieces[white ? KNIGHT_WHITE : KNIGHT_BLACK]) |
+		   (king_attacks[square] & pieces[white ? KING_WHITE : KING_BLACK]) |
+		   (pawn_attacks[white ? PLAYER_BLACK : PLAYER_WHITE][square] & pieces[white ? PAWN_WHITE : PAWN_BLACK]) |
+		   (BishopAttacks(square, blockers) & (pieces[white ? BISHOP_WHITE : BISHOP_BLACK] | queens)) |
+		   (RookAttacks(square, blockers) & (pieces[white ? ROOK_WHITE : ROOK_BLACK] | queens));
+}
+
 /****************************************************************************
  * Name:        InCheck
  * Input:       player - int
  * Output:      None
  * Returns:     bool
  * Description: Returns true if the player is in check.
- * Invokes:     GenerateMoves()
+ * Invokes:     SquareAttacked()
  * Note:        None
  ***************************************************************************/
 // Returns true if the given player is in check
 bool Chess::InCheck(int player)
 {
-	Move move_list[75];
-
-	int num_moves = GenerateMoves(move_list, player == PLAYER_WHITE ? PLAYER_BLACK : PLAYER_WHITE);
-
-	// Examine all moves, any moves resulting in the king being captured denotes "check"
-	for (int i = 0; i < num_moves; i++)
-	{
-		if (player == PLAYER_WHITE && move_list[i].captured == KING_WHITE)
-			return true;
+	Bitboard king = pieces[player == PLAYER_WHITE ? KING_WHITE : KING_BLACK];
 
-		if (player == PLAYER_BLACK && move_list[i].captured == KING_BLACK)
-			return true;
-	}
+	// No king on the board (only ever seen inside the search)
+	if (!king)
+		return false;
 
-	return false;
+	return SquareAttacked(LowestSquare(king), player == PLAYER_WHITE ? PLAYER_BLACK : PLAYER_WHITE);
 }
 
 /****************************************************************************
@@ -207,35 +1290,17 @@ bool Chess::InCheck(int player)
  * Returns:     true or false indicating if the player is in checkmate
  * Description: Checks if a player is in checkmate and returns an appropriate
  *				boolean.
- * Invokes:     GenerateMove()
- *				SimulateMove()
- *				UnSimulateMove()
- *				InCheck()
- * Note:        None
+ * Invokes:     InCheck()
+ *				GenerateMoves()
+ * Note:        The player is mated when in check with no legal moves left.
+ *				Since GenerateMoves() only gives legal moves, there's no need
+ *				to try each one, and finding a single move is enough.
  ***************************************************************************/
 bool Chess::InCheckmate(int player)
 {
-	Move move_list[75];
+	Move move_list[MAX_MOVES];
 
-	int num_moves = GenerateMoves(move_list, player);
-
-	bool check_mate = true;
-
-	// For every move, make the move, then find out
-	// if we are still in check
-	for (int i = 0; i < num_moves; i++)
-	{
-		SimulateMove(&move_list[i]);
-
-		check_mate = InCheck(player);
-
-		UnSimulateMove(&move_list[i]);
-
-		if (!check_mate)
-			return false;
-	}
-
-	return true;
+	return InCheck(player) && GenerateMoves(move_list, player, true) == 0;
 }
 
 /****************************************************************************
@@ -245,78 +1310,105 @@ bool Chess::InCheckmate(int player)
  * Returns:     true or false indicating if the game is a stalemate
  * Description: Given the current board configuration, returns an appropriate
  *				boolean if the game has reached stalemate status.
- * Invokes:     None
+ * Invokes:     Repetitions()
  * Note:        Stalemate can happen in the following ways:
- *				1. Each player makes the same sequence of moves for 3 straight
- *				   turns.
- *				2. The pieces remaining on the board are such that neither play
+ *				1. The same position comes up for the third time.
+ *				2. Fifty moves each go by without a capture or pawn move.
+ *				3. The pieces remaining on the board are such that neither play
  *				   can win.
  ***************************************************************************/
 bool Chess::Stalemate()
 {
-	int bbishop = 0;
-	int wbishop = 0;
-	int bknight = 0;
-	int wknight = 0;
-
-	// Case 1: check the last few moves
-	if (last_12_moves[0] == last_12_moves[4] && last_12_moves[0] == last_12_moves[8] &&
-		last_12_moves[1] == last_12_moves[5] && last_12_moves[1] == last_12_moves[9] &&
-		last_12_moves[2] == last_12_moves[6] && last_12_moves[2] == last_12_moves[10] &&
-		last_12_moves[3] == last_12_moves[7] && last_12_moves[3] == last_12_moves[11])
+	// Case 1: the position has been seen twice before
+	if (Repetitions() >= 2)
 		return true;
 
-	// Case 2: count the number of pieces
-	for (int x = 0; x < 8; x++)
-	{
-		for (int y = 0; y < 8; y++)
-		{
-			if (board[x][y] == PAWN_WHITE || board[x][y] == PAWN_BLACK) return false;
-			if (board[x][y] == ROOK_WHITE || board[x][y] == ROOK_BLACK) return false;
-			if (board[x][y] == QUEEN_WHITE || board[x][y] == QUEEN_BLACK) return false;
+	// Case 2: the fifty move rule
+	if (halfmove_clock >= 100)
+		return true;
 
-			if (board[x][y] == KNIGHT_WHITE) wknight++;
-			if (board[x][y] == KNIGHT_BLACK) bknight++;
-			if (board[x][y] == BISHOP_WHITE) wbishop++;
-			if (board[x][y] == BISHOP_WHITE) bbishop++;
+	// Case 3: count the number of pieces
+	if (pieces[PAWN_WHITE] | pieces[PAWN_BLACK]) return false;
+	if (pieces[ROOK_WHITE] | pieces[ROOK_BLACK]) return false;
+	if (pieces[QUEEN_WHITE] | pieces[QUEEN_BLACK]) return false;
 
-			if (bknight + bbishop > 1) return false;
-			if (wknight + wbishop > 1) return false;
-		}
-	}
+	if (PopCount(pieces[KNIGHT_WHITE] | pieces[BISHOP_WHITE]) > 1) return false;
+	if (PopCount(pieces[KNIGHT_BLACK] | pieces[BISHOP_BLACK]) > 1) return false;
 
 	return true;
 }
 
 /****************************************************************************
- * Name:        Update
- * Input:       None
+ * Name:        Repetitions
+ * Input:       None
+ * Output:      None
+ * Returns:     the number of earlier times the current position came up
+ * Description: Looks back through the position keys for the current one.
+ * Invokes:     None
+ * Note:        Only every other position has the same player to move, and
+ *				nothing from before the last capture or pawn move can repeat,
+ *				so the walk is short.  Simulated moves count too, which lets
+ *				the search spot repetitions inside its own tree.
+ ***************************************************************************/
+int Chess::Repetitions()
+{
+	int count = 0;
+
+	for (int i = 4; i <= halfmove_clock && i <= history_count; i += 2)
+	{
+		if (history[(history_count - i) & (HISTORY_SIZE - 1)] == hash)
+			count++;
+	}
+
+	return count;
+}
+
+/****************************************************************************
+ * Name:        Update
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: This function updates the state of the game for the player
+ *		whose turn it now is.
+ * Invokes:     Classify()
+ * Note:        The turn has already been passed on by SimulateMove().
+ ***************************************************************************/
+void Chess::Update()
+{
+	game_state = Classify(turn);
+}
+
+/****************************************************************************
+ * Name:        Classify
+ * Input:       player - int
  * Output:      None
- * Returns:     None
- * Description: This function updates the state of the game.  It checks for
- *		stalemate, check, and checkmate.  It updates the game_state variable
- *		accordingly.  It also flips the turn to the opponent.
- * Invokes:     InCheckmate()
- *				InCheck()
+ * Returns:     STATE_NORMAL, STATE_CHECK, STATE_CHECKMATE or STATE_STALEMATE
+ * Description: Works out the state of the game from player's point of view
+ *		in one go - whether the king is in check and whether there is any
+ *		legal move at all, then the draw rules.
+ * Invokes:     InCheck()
+ *				GenerateMoves()
  *				Stalemate()
- *				ToggleTurn()
- * Note:        None
+ * Note:        Move generation stops at the first legal move, so a normal
+ *		position costs little more than finding one piece that can move.
  ***************************************************************************/
-void Chess::Update()
+int Chess::Classify(int player)
 {
-	ToggleTurn();
+	Move move_list[MAX_MOVES];
 
-	if (InCheckmate(turn))
-		game_state = STATE_CHECKMATE;
+	bool check = InCheck(player);
+	bool can_move = (GenerateMoves(move_list, player, true) > 0);
 
-	else if (InCheck(turn))
-		game_state = STATE_CHECK;
+	if (!can_move)
+		return (check ? STATE_CHECKMATE : STATE_STALEMATE);
 
-	else if (Stalemate())
-		game_state = STATE_STALEMATE;
+	if (check)
+		return STATE_CHECK;
 
-	else
-		game_state = STATE_NORMAL;
+	if (Stalemate())
+		return STATE_STALEMATE;
+
+	return STATE_NORMAL;
 }
 
 /****************************************************************************
@@ -334,7 +1426,10 @@ void Chess::Update()
 void Chess::ReplaceBoard(int piece, int x, int y)
 {
 	if (x >= 0 && x < 8 && y >= 0 && y < 8)
-		board[x][y] = piece;
+	{
+		RemovePiece(SQUARE(x, y));
+		PutPiece(piece, SQUARE(x, y));
+	}
 }
 
 /****************************************************************************
@@ -360,49 +1455,123 @@ void Chess::ToggleTurn()
  *				It's called "simulate" move because it is also used in a 
  *				backtracking sense for our AI search.  We need the flexibility
  *				to make a move, then undo it.  That's exactly what this function
- *				allows us to do.
+ *				allows us to do.  Everything the move changes - castling,
+ *				en passant, the halfmove clock, the hash and the turn - is
+ *				updated here, and the old values saved on the undo stack.
  * Invokes:     WhitePiece()
- *				BlackPiece()
+ *				CastleHash()
+ *				ToggleTurn()
  * Note:        None
  ***************************************************************************/
 void Chess::SimulateMove(Move *m)
 {
+	int from = m->From();
+	int to = m->To();
+	int piece = squares[from];
+
+	// Remember what was captured so the move can be undone
+	Undo &undo = undo_stack[undo_count++];
+
+	undo.captured = GetCaptured(*m);
+	undo.halfmove_clock = halfmove_clock;
+	undo.enpassant_x = enpassant_x;
+	undo.WhiteCastleLeft = WhiteCastleLeft;
+	undo.WhiteCastleRight = WhiteCastleRight;
+	undo.BlackCastleLeft = BlackCastleLeft;
+	undo.BlackCastleRight = BlackCastleRight;
+	undo.hash = hash;
+
+	// Captures and pawn moves can never be repeated
+	if (undo.captured != EMPTY || piece == PAWN_WHITE || piece == PAWN_BLACK)
+		halfmove_clock = 0;
+	else
+		halfmove_clock++;
+
+	history[history_count++ & (HISTORY_SIZE - 1)] = hash;
+
+	// Take the old castling flags and en passant column out of the hash
+	hash ^= CastleHash();
+
+	if (enpassant_x >= 0)
+		hash ^= enpassant_keys[enpassant_x];
+
 	// Normally we just update the new and old locations on the board
-	board[m->oldx][m->oldy] = EMPTY;
-	board[m->newx][m->newy] = m->piece;
+	RemovePiece(from);
+	RemovePiece(to);
 
 	// enpassant, castle, and promotion have special considerations
-	if (m->enpassant)
+	if (m->Promotion())
+		PutPiece(WhitePiece(piece) ? m->Promoted() : m->Promoted() + 10, to);
+	else
+		PutPiece(piece, to);
+
+	if (m->Enpassant())
 	{
-		board[m->newx][m->oldy] = EMPTY;
+		RemovePiece(SQUARE(m->NewX(), m->OldY()));
 	}
 
-	if (m->castle)
+	if (m->Castle())
 	{
-		if (m->newx == 2)
+		if (m->NewX() == 2)
 		{
-			board[3][m->newy] = board[0][m->newy];
-			board[0][m->newy] = EMPTY;
+			PutPiece(squares[SQUARE(0, m->NewY())], SQUARE(3, m->NewY()));
+			RemovePiece(SQUARE(0, m->NewY()));
 		}
 
-		else if (m->newx == 6)
+		else if (m->NewX() == 6)
 		{
-			board[5][m->newy] = board[7][m->newy];
-			board[7][m->newy] = EMPTY;
+			PutPiece(squares[SQUARE(7, m->NewY())], SQUARE(5, m->NewY()));
+			RemovePiece(SQUARE(7, m->NewY()));
 		}
 	}
 
-	if (m->promotion)
+	// Update the availability of castling - moving the king loses both
+	// sides, moving or losing a rook loses its side
+	if (piece == KING_WHITE)
 	{
-		if (WhitePiece(m->piece))
-			board[m->newx][m->newy] = QUEEN_WHITE;
-		else
-			board[m->newx][m->newy] = QUEEN_BLACK;
+		WhiteCastleLeft = false;
+		WhiteCastleRight = false;
+	}
+
+	else if (piece == KING_BLACK)
+	{
+		BlackCastleLeft = false;
+		BlackCastleRight = false;
 	}
 
-	// if we capture a piece, the total number of pieces drops
-	if (m->captured != EMPTY)
-		num_pieces--;
+	if (from == SQUARE(0, 0) || to == SQUARE(0, 0))
+		BlackCastleLeft = false;
+
+	if (from == SQUARE(0, 7) || to == SQUARE(0, 7))
+		WhiteCastleLeft = false;
+
+	if (from == SQUARE(7, 0) || to == SQUARE(7, 0))
+		BlackCastleRight = false;
+
+	if (from == SQUARE(7, 7) || to == SQUARE(7, 7))
+		WhiteCastleRight = false;
+
+	// A pawn that just stepped two squares can be taken en passant - but
+	// only by an enemy pawn beside it.  Without one the position is the
+	// same as after a single step, and has to hash the same.
+	enpassant_x = -1;
+
+	if ((piece == PAWN_WHITE || piece == PAWN_BLACK) && (m->OldY() - m->NewY() == 2 || m->NewY() - m->OldY() == 2) &&
+		PawnBeside(m->NewX(), m->NewY(), piece == PAWN_WHITE ? PAWN_BLACK : PAWN_WHITE))
+		enpassant_x = m->NewX();
+
+	// Put the new castling flags and en passant column into the hash
+	hash ^= CastleHash();
+
+	if (enpassant_x >= 0)
+		hash ^= enpassant_keys[enpassant_x];
+
+	// The other player moves next, a new move number after black's turn
+	if (turn == PLAYER_BLACK)
+		fullmove_number++;
+
+	hash ^= turn_key;
+	ToggleTurn();
 }
 
 /****************************************************************************
@@ -412,87 +1581,148 @@ void Chess::SimulateMove(Move *m)
  * Returns:     None
  * Description: This is the function that undoes a given move.  All values are
  *				returned to their status before the move was made.
- * Invokes:     None
- * Note:        None
+ * Invokes:     ToggleTurn()
+ * Note:        Moves must be undone in the reverse order they were made.
  ***************************************************************************/
 void Chess::UnSimulateMove(Move *m)
 {
-	// If the move was enpassant, the captured piece doesn't go back
-	// to the destination
-	if (!m->enpassant)
-		board[m->newx][m->newy] = m->captured;
+	int from = m->From();
+	int to = m->To();
+	int piece = squares[to];
+	Undo &undo = undo_stack[--undo_count];
+	int captured = undo.captured;
 
-	board[m->oldx][m->oldy] = m->piece;
+	history_count--;
 
-	// special cases (promotion takes care of itself here because the
-	// m->piece variable will still be a pawn)
-	if (m->enpassant)
-	{
-		board[m->newx][m->newy] = EMPTY;
-		board[m->newx][m->oldy] = m->captured;
-	}
+	// A promoted piece goes back to being a pawn
+	if (m->Promotion())
+		piece = (WhitePiece(piece) ? PAWN_WHITE : PAWN_BLACK);
+
+	RemovePiece(to);
+	PutPiece(piece, from);
+
+	// If the move was enpassant, the captured piece doesn't go back
+	// to the destination
+	if (m->Enpassant())
+		PutPiece(captured, SQUARE(m->NewX(), m->OldY()));
+	else
+		PutPiece(captured, to);
 
-	if (m->castle)
+	if (m->Castle())
 	{
-		if (m->newx == 2)
+		if (m->NewX() == 2)
 		{
-			board[0][m->newy] = board[3][m->newy];
-			board[3][m->newy] = EMPTY;
+			PutPiece(squares[SQUARE(3, m->NewY())], SQUARE(0, m->NewY()));
+			RemovePiece(SQUARE(3, m->NewY()));
 		}
 
-		if (m->newx == 6)
+		if (m->NewX() == 6)
 		{
-			board[7][m->newy] = board[5][m->newy];
-			board[5][m->newy] = EMPTY;
+			PutPiece(squares[SQUARE(5, m->NewY())], SQUARE(7, m->NewY()));
+			RemovePiece(SQUARE(5, m->NewY()));
 		}
 	}
 
-	if (m->captured != EMPTY)
-		num_pieces++;
+	// Everything else comes straight off the undo record
+	halfmove_clock = undo.halfmove_clock;
+	enpassant_x = undo.enpassant_x;
+	WhiteCastleLeft = undo.WhiteCastleLeft;
+	WhiteCastleRight = undo.WhiteCastleRight;
+	BlackCastleLeft = undo.BlackCastleLeft;
+	BlackCastleRight = undo.BlackCastleRight;
+	hash = undo.hash;
+
+	ToggleTurn();
+
+	if (turn == PLAYER_BLACK)
+		fullmove_number--;
 }
 
 /****************************************************************************
- * Name:        FinalizeMove
- * Input:       m - pointer to a move
+ * Name:        SimulateNullMove
+ * Input:       None
  * Output:      None
  * Returns:     None
- * Description: This updates odds and ends that are not necessary to include
- *				in the search but still must be done after every move is made.
- * Invokes:     None
- * Note:        None
+ * Description: Hands the turn to the other player without moving anything,
+ *				saving the old values on the undo stack the same way
+ *				SimulateMove() does.  Any chance to take en passant is lost.
+ * Invokes:     ToggleTurn()
+ * Note:        Passing isn't legal chess - the search uses it to see if a
+ *				position is so good that even a free move for the opponent
+ *				doesn't help them.  The halfmove clock starts over, so no
+ *				repetition is ever counted across a pass.
  ***************************************************************************/
-void Chess::FinalizeMove(Move *m)
+void Chess::SimulateNullMove()
 {
-	// Update the availability of castling
-	if (m->piece == KING_WHITE)
-	{
-		WhiteCastleLeft = false;
-		WhiteCastleRight = false;
-	}
+	Undo &undo = undo_stack[undo_count++];
+
+	undo.captured = EMPTY;
+	undo.halfmove_clock = halfmove_clock;
+	undo.enpassant_x = enpassant_x;
+	undo.WhiteCastleLeft = WhiteCastleLeft;
+	undo.WhiteCastleRight = WhiteCastleRight;
+	undo.BlackCastleLeft = BlackCastleLeft;
+	undo.BlackCastleRight = BlackCastleRight;
+	undo.hash = hash;
 
-	else if (m->piece == KING_BLACK)
+	halfmove_clock = 0;
+	history[history_count++ & (HISTORY_SIZE - 1)] = hash;
+
+	if (enpassant_x >= 0)
 	{
-		BlackCastleLeft = false;
-		BlackCastleRight = false;
+		hash ^= enpassant_keys[enpassant_x];
+		enpassant_x = -1;
 	}
 
-	if (m->oldx == 0 && m->oldy == 0)
-		BlackCastleLeft = false;
+	if (turn == PLAYER_BLACK)
+		fullmove_number++;
 
-	else if (m->oldx == 0 && m->oldy == 7)
-		WhiteCastleLeft = false;
+	hash ^= turn_key;
+	ToggleTurn();
+}
 
-	else if (m->oldx == 7 && m->oldy == 0)
-		BlackCastleRight = false;
+/****************************************************************************
+ * Name:        UnSimulateNullMove
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Takes back a pass made by SimulateNullMove().
+ * Invokes:     ToggleTurn()
+ * Note:        Like moves, passes must be undone in the reverse order.
+ ***************************************************************************/
+void Chess::UnSimulateNullMove()
+{
+	Undo &undo = undo_stack[--undo_count];
 
-	else if (m->oldx == 7 && m->oldy == 7)
-		WhiteCastleRight = false;
+	history_count--;
+
+	halfmove_clock = undo.halfmove_clock;
+	enpassant_x = undo.enpassant_x;
+	hash = undo.hash;
+
+	ToggleTurn();
 
-	// Add the move the list of the last 12 moves
-	for (int i = 11; i > 0; i--)
-		last_12_moves[i] = last_12_moves[i-1];
+	if (turn == PLAYER_BLACK)
+		fullmove_number--;
+}
 
-	last_12_moves[0] = *m;
+/****************************************************************************
+ * Name:        FinalizeMove
+ * Input:       pointer to the move just made (not needed any more, the
+ *				undo record says it all)
+ * Output:      None
+ * Returns:     None
+ * Description: Marks the last move made as part of the game, dropping its
+ *				undo record so the stack only ever holds moves being searched.
+ * Invokes:     None
+ * Note:        SimulateMove() has already done all the work, so the search
+ *				never needs to call this.  The move's position key stays in
+ *				the history for spotting repetitions.
+ ***************************************************************************/
+void Chess::FinalizeMove(Move *)
+{
+	// The move is final, it will never be undone
+	undo_count--;
 }
 
 /****************************************************************************
@@ -503,11 +1733,12 @@ void Chess::FinalizeMove(Move *m)
  * Returns:     an integer representing a piece
  * Description: This gets the piece currently at position x,y on the board.
  * Invokes:     None
- * Note:        None
+ * Note:        The board itself lives in bitboards, this is a view onto it
+ *				for the drawing code and the user interface.
  ***************************************************************************/
 int Chess::GetBoard(int x, int y)
 {
-	return board[x][y];
+	return squares[SQUARE(x, y)];
 }
 
 /****************************************************************************
@@ -527,170 +1758,135 @@ int Chess::GetBoard(int x, int y)
  ***************************************************************************/
 bool Chess::LegalMove(Move *m)
 {
-	int delta_x;
-	int delta_y;
+	int oldx = m->OldX();
+	int oldy = m->OldY();
+	int newx = m->NewX();
+	int newy = m->NewY();
+
+	int piece = squares[m->From()];
 
 	// Can't capture a piece of the same type
-	if (board[m->newx][m->newy] != EMPTY)
+	if (squares[SQUARE(newx, newy)] != EMPTY)
 	{
-		if (WhitePiece(m->piece) && WhitePiece(board[m->newx][m->newy]))
+		if (WhitePiece(piece) && WhitePiece(squares[SQUARE(newx, newy)]))
 			return false;
-		if (BlackPiece(m->piece) && BlackPiece(board[m->newx][m->newy]))
+		if (BlackPiece(piece) && BlackPiece(squares[SQUARE(newx, newy)]))
 			return false;
 	}
 
-	m->castle = false;
-	m->promotion = false;
-	m->enpassant = false;
+	m->SetFlag(MOVE_NORMAL);
 
-	switch (m->piece)
+	switch (piece)
 	{
 		case PAWN_BLACK:
 			// Special case - enpassant
-			if (m->newy == 5 && m->oldy == 4 && (m->newx == m->oldx - 1 || m->newx == m->oldx + 1) && board[m->newx][m->newy] == EMPTY)
+			if (newy == 5 && oldy == 4 && (newx == oldx - 1 || newx == oldx + 1) && squares[SQUARE(newx, newy)] == EMPTY)
 			{
-				if (last_12_moves[0].piece == PAWN_WHITE && last_12_moves[0].oldy == 6 && last_12_moves[0].newy == 4 && last_12_moves[0].newx == m->newx)
+				if (enpassant_x == newx && squares[SQUARE(newx, 4)] == PAWN_WHITE)
 				{
-					m->enpassant = true;
-					m->captured = board[m->newx][m->oldy];
+					m->SetFlag(MOVE_ENPASSANT);
 					return true;
 				}
 			}
 
 			// Moving forward 2 spaces - only valid from the initial position
-			if (m->oldy != m->newy - 1)
+			if (oldy != newy - 1)
 			{
-				if (m->oldy == 1 && m->newy == 3 && m->oldx == m->newx)
+				if (oldy == 1 && newy == 3 && oldx == newx)
 				{
 					// Only valid if there is nothing in the way
-					if (board[m->newx][m->newy-1] != EMPTY) return false;
+					if (squares[SQUARE(newx, newy-1)] != EMPTY) return false;
 				}
 
 				else return false;
 			}
 
 			// Can't move forward to non empty spots
-			if (m->oldx == m->newx && board[m->newx][m->newy] != EMPTY)
+			if (oldx == newx && squares[SQUARE(newx, newy)] != EMPTY)
 				return false;
 
 			// Can only move diagonal by 1
-			if (m->oldx > m->newx + 1 || m->oldx < m->newx - 1)
+			if (oldx > newx + 1 || oldx < newx - 1)
 				return false;
 
 			// Can only move diagonal if there is a piece to capture
-			if (m->oldx == m->newx + 1 || m->oldx == m->newx - 1)
+			if (oldx == newx + 1 || oldx == newx - 1)
 			{
-				if (board[m->newx][m->newy] == EMPTY)
+				if (squares[SQUARE(newx, newy)] == EMPTY)
 					return false;
 			}
 
-			if (m->newy == 7)
-				m->promotion = true;
+			if (newy == 7)
+				m->SetFlag(MOVE_PROMOTION);
 		break;
 
 		case PAWN_WHITE:
 			// Special case - enpassant
-			if (m->newy == 2 && m->oldy == 3 && (m->newx == m->oldx - 1 || m->newx == m->oldx + 1) && board[m->newx][m->newy] == EMPTY)
+			if (newy == 2 && oldy == 3 && (newx == oldx - 1 || newx == oldx + 1) && squares[SQUARE(newx, newy)] == EMPTY)
 			{
-				if (last_12_moves[0].piece == PAWN_BLACK && last_12_moves[0].oldy == 1 && last_12_moves[0].newy == 3 && last_12_moves[0].newx == m->newx)
+				if (enpassant_x == newx && squares[SQUARE(newx, 3)] == PAWN_BLACK)
 				{
-					m->enpassant = true;
-					m->captured = board[m->newx][m->oldy];
+					m->SetFlag(MOVE_ENPASSANT);
 					return true;
 				}
 			}
 
 			// Moving forward 2 spaces - only valid from the initial position
-			if (m->oldy != m->newy + 1)
+			if (oldy != newy + 1)
 			{
-				if (m->oldy == 6 && m->newy == 4 && m->oldx == m->newx)
+				if (oldy == 6 && newy == 4 && oldx == newx)
 				{
-					if (board[m->newx][m->newy+1] != EMPTY) return false;
+					if (squares[SQUARE(newx, newy+1)] != EMPTY) return false;
 				}
 
 				else return false;
 			}
 
 			// Can't move forward to non empty spots
-			if (m->oldx == m->newx && board[m->newx][m->newy] != EMPTY)
+			if (oldx == newx && squares[SQUARE(newx, newy)] != EMPTY)
 				return false;
 
 			// Can only move diagonal by 1
-			if (m->oldx > m->newx + 1 || m->oldx < m->newx - 1)
+			if (oldx > newx + 1 || oldx < newx - 1)
 				return false;
 
 			// Can only move diagonal if there is a piece to capture
-			if (m->oldx == m->newx + 1 || m->oldx == m->newx - 1)
+			if (oldx == newx + 1 || oldx == newx - 1)
 			{
-				if (board[m->newx][m->newy] == EMPTY)
+				if (squares[SQUARE(newx, newy)] == EMPTY)
 					return false;
 			}
 
-			if (m->newy == 0)
-				m->promotion = true;
+			if (newy == 0)
+				m->SetFlag(MOVE_PROMOTION);
 		break;
 
 
 		case ROOK_BLACK:
 		case ROOK_WHITE:
-			// Have to move along a straight line
-			if (m->oldx != m->newx && m->oldy != m->newy)
+			// Have to move along a straight line with nothing in the way
+			if (!(RookAttacks(SQUARE(oldx, oldy), occupied) & SQUARE_BIT(SQUARE(newx, newy))))
 				return false;
-
-			// 4 directions
-			if (m->oldx == m->newx)
-			{
-				if (m->oldy > m->newy + 1)
-				{
-					for (int y = m->oldy - 1; y > m->newy; y--)
-						if (board[m->newx][y] != EMPTY)
-							return false;
-				}
-
-				if (m->oldy < m->newy - 1)
-				{
-					for (int y = m->oldy + 1; y < m->newy; y++)
-						if (board[m->newx][y] != EMPTY)
-							return false;
-				}
-			}
-
-			if (m->oldy == m->newy)
-			{
-				if (m->oldx > m->newx + 1)
-				{
-					for (int x = m->oldx - 1; x > m->newx; x--)
-						if (board[x][m->newy] != EMPTY)
-							return false;
-				}
-
-				if (m->oldx < m->newx - 1)
-				{
-					for (int x = m->oldx + 1; x < m->newx; x++)
-						if (board[x][m->newy] != EMPTY)
-							return false;
-				}
-			}
 		break;
 
 		case KNIGHT_BLACK:
 		case KNIGHT_WHITE:
 			// 8 possible moves for knights
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy + 2)
+			if (oldx == newx + 1 && oldy == newy + 2)
 				return true;
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy - 2)
+			if (oldx == newx + 1 && oldy == newy - 2)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy + 2)
+			if (oldx == newx - 1 && oldy == newy + 2)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy - 2)
+			if (oldx == newx - 1 && oldy == newy - 2)
 				return true;
-			if (m->oldx == m->newx + 2 && m->oldy == m->newy + 1)
+			if (oldx == newx + 2 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx + 2 && m->oldy == m->newy - 1)
+			if (oldx == newx + 2 && oldy == newy - 1)
 				return true;
-			if (m->oldx == m->newx - 2 && m->oldy == m->newy + 1)
+			if (oldx == newx - 2 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx - 2 && m->oldy == m->newy - 1)
+			if (oldx == newx - 2 && oldy == newy - 1)
 				return true;
 			else
 				return false;
@@ -698,272 +1894,106 @@ bool Chess::LegalMove(Move *m)
 
 		case BISHOP_BLACK:
 		case BISHOP_WHITE:
-			// Must move along a diagonal line
-			delta_x = m->oldx - m->newx;
-			delta_y = m->oldy - m->newy;
-
-			AbsValue(delta_x);
-			AbsValue(delta_y);
-	
-			if (delta_x != delta_y) return false;
-			
-			// 4 directions
-			if (m->oldx > m->newx + 1 && m->oldy > m->newy + 1)
-			{
-				int x = m->oldx - 1;
-				int y = m->oldy - 1;
-
-				while (x > m->newx)
-				{
-					if (board[x][y] != EMPTY)
-						return false;
-					x--;
-					y--;
-				}
-			}
-
-			if (m->oldx > m->newx + 1 && m->oldy < m->newy - 1)
-			{
-				int x = m->oldx - 1;
-				int y = m->oldy + 1;
-
-				while (x > m->newx)
-				{
-					if (board[x][y] != EMPTY)
-						return false;
-					x--;
-					y++;
-				}
-			}
-
-			if (m->oldx < m->newx - 1 && m->oldy > m->newy + 1)
-			{
-				int x = m->oldx + 1;
-				int y = m->oldy - 1;
-
-				while (x < m->newx)
-				{
-					if (board[x][y] != EMPTY)
-						return false;
-					
-					x++;
-					y--;
-				}
-			}
-
-			if (m->oldx < m->newx - 1 && m->oldy < m->newy - 1)
-			{
-				int x = m->oldx + 1;
-				int y = m->oldy + 1;
-
-				while(x < m->newx)
-				{
-					if (board[x][y] != EMPTY)
-						return false;
-
-					x++;
-					y++;
-				}
-			}
+			// Must move along a diagonal line with nothing in the way
+			if (!(BishopAttacks(SQUARE(oldx, oldy), occupied) & SQUARE_BIT(SQUARE(newx, newy))))
+				return false;
 		break;
 
 		case QUEEN_BLACK:
 		case QUEEN_WHITE:
 			// Combination of rook and bishop conditions
-			if (m->oldx != m->newx && m->oldy != m->newy)
-			{
-				delta_x = m->oldx - m->newx;
-				delta_y = m->oldy - m->newy;
-
-				AbsValue(delta_x);
-				AbsValue(delta_y);
-		
-				if (delta_x != delta_y) return false;
-				
-				if (m->oldx > m->newx + 1 && m->oldy > m->newy + 1)
-				{
-					int x = m->oldx - 1;
-					int y = m->oldy - 1;
-
-					while (x > m->newx)
-					{
-						if (board[x][y] != EMPTY)
-							return false;
-						x--;
-						y--;
-					}
-				}
-
-				if (m->oldx > m->newx + 1 && m->oldy < m->newy - 1)
-				{
-					int x = m->oldx - 1;
-					int y = m->oldy + 1;
-
-					while (x > m->newx)
-					{
-						if (board[x][y] != EMPTY)
-							return false;
-						x--;
-						y++;
-					}
-				}
-
-				if (m->oldx < m->newx - 1 && m->oldy > m->newy + 1)
-				{
-					int x = m->oldx + 1;
-					int y = m->oldy - 1;
-
-					while (x < m->newx)
-					{
-						if (board[x][y] != EMPTY)
-							return false;
-						
-						x++;
-						y--;
-					}
-				}
-
-				if (m->oldx < m->newx - 1 && m->oldy < m->newy - 1)
-				{
-					int x = m->oldx + 1;
-					int y = m->oldy + 1;
-
-					while(x < m->newx)
-					{
-						if (board[x][y] != EMPTY)
-							return false;
-
-						x++;
-						y++;
-					}
-				}
-			}
-
-			else
-			{
-				if (m->oldx == m->newx)
-				{
-					if (m->oldy > m->newy + 1)
-					{
-						for (int y = m->oldy - 1; y > m->newy; y--)
-							if (board[m->newx][y] != EMPTY)
-								return false;
-					}
-
-					if (m->oldy < m->newy - 1)
-					{
-						for (int y = m->oldy + 1; y < m->newy; y++)
-							if (board[m->newx][y] != EMPTY)
-								return false;
-					}
-				}
-
-				if (m->oldy == m->newy)
-				{
-					if (m->oldx > m->newx + 1)
-					{
-						for (int x = m->oldx - 1; x > m->newx; x--)
-							if (board[x][m->newy] != EMPTY)
-								return false;
-					}
-
-					if (m->oldx < m->newx - 1)
-					{
-						for (int x = m->oldx + 1; x < m->newx; x++)
-							if (board[x][m->newy] != EMPTY)
-								return false;
-					}
-				}
-			}
+			if (!((RookAttacks(SQUARE(oldx, oldy), occupied) | BishopAttacks(SQUARE(oldx, oldy), occupied)) &
+				  SQUARE_BIT(SQUARE(newx, newy))))
+				return false;
 		break;
 
 		case KING_BLACK:
 			// Castling
-			if (m->oldx == 4 && m->oldy == 0 && m->newx == 2 && m->newy == 0)
+			if (oldx == 4 && oldy == 0 && newx == 2 && newy == 0)
 			{
-				if (board[1][0] == EMPTY && board[2][0] == EMPTY && board[3][0] == EMPTY)
+				if (squares[SQUARE(1, 0)] == EMPTY && squares[SQUARE(2, 0)] == EMPTY && squares[SQUARE(3, 0)] == EMPTY)
 				{
-					if (BlackCastleLeft && board[0][0] == ROOK_BLACK)
+					if (BlackCastleLeft && squares[SQUARE(0, 0)] == ROOK_BLACK)
 					{
-						m->castle = true;
+						m->SetFlag(MOVE_CASTLE);
 						return true;
 					}
 				}
 			}
 
-			else if (m->oldx == 4 && m->oldy == 0 && m->newx == 6 && m->newy == 0)
+			else if (oldx == 4 && oldy == 0 && newx == 6 && newy == 0)
 			{
-				if (board[5][0] == EMPTY && board[6][0] == EMPTY)
+				if (squares[SQUARE(5, 0)] == EMPTY && squares[SQUARE(6, 0)] == EMPTY)
 				{
-					if (BlackCastleRight && board[7][0] == ROOK_BLACK)
+					if (BlackCastleRight && squares[SQUARE(7, 0)] == ROOK_BLACK)
 					{
-						m->castle = true;
+						m->SetFlag(MOVE_CASTLE);
 						return true;
 					}
 				}
 			}
 
 			// 8 possibilities for kings
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy)
+			if (oldx == newx + 1 && oldy == newy)
 				return true;
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy + 1)
+			if (oldx == newx + 1 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy - 1)
+			if (oldx == newx + 1 && oldy == newy - 1)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy)
+			if (oldx == newx - 1 && oldy == newy)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy + 1)
+			if (oldx == newx - 1 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy - 1)
+			if (oldx == newx - 1 && oldy == newy - 1)
 				return true;
-			if (m->oldx == m->newx && m->oldy == m->newy + 1)
+			if (oldx == newx && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx && m->oldy == m->newy - 1)
+			if (oldx == newx && oldy == newy - 1)
 				return true;
 			else
 				return false;
 		break;
 
 		case KING_WHITE:
-			if (m->oldx == 4 && m->oldy == 7 && m->newx == 2 && m->newy == 7)
+			if (oldx == 4 && oldy == 7 && newx == 2 && newy == 7)
 			{
-				if (board[1][7] == EMPTY && board[2][7] == EMPTY && board[3][7] == EMPTY)
+				if (squares[SQUARE(1, 7)] == EMPTY && squares[SQUARE(2, 7)] == EMPTY && squares[SQUARE(3, 7)] == EMPTY)
 				{
-					if (WhiteCastleLeft && board[0][7] == ROOK_WHITE)
+					if (WhiteCastleLeft && squares[SQUARE(0, 7)] == ROOK_WHITE)
 					{
-						m->castle = true;
+						m->SetFlag(MOVE_CASTLE);
 						return true;
 					}
 				}
 			}
 
-			else if (m->oldx == 4 && m->oldy == 7 && m->newx == 6 && m->newy == 7)
+			else if (oldx == 4 && oldy == 7 && newx == 6 && newy == 7)
 			{
-				if (board[5][7] == EMPTY && board[6][7] == EMPTY)
+				if (squares[SQUARE(5, 7)] == EMPTY && squares[SQUARE(6, 7)] == EMPTY)
 				{
-					if (WhiteCastleRight && board[7][7] == ROOK_WHITE)
+					if (WhiteCastleRight && squares[SQUARE(7, 7)] == ROOK_WHITE)
 					{
-						m->castle = true;
+						m->SetFlag(MOVE_CASTLE);
 						return true;
 					}
 				}
 			}
 
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy)
+			if (oldx == newx + 1 && oldy == newy)
 				return true;
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy + 1)
+			if (oldx == newx + 1 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx + 1 && m->oldy == m->newy - 1)
+			if (oldx == newx + 1 && oldy == newy - 1)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy)
+			if (oldx == newx - 1 && oldy == newy)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy + 1)
+			if (oldx == newx - 1 && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx - 1 && m->oldy == m->newy - 1)
+			if (oldx == newx - 1 && oldy == newy - 1)
 				return true;
-			if (m->oldx == m->newx && m->oldy == m->newy + 1)
+			if (oldx == newx && oldy == newy + 1)
 				return true;
-			if (m->oldx == m->newx && m->oldy == m->newy - 1)
+			if (oldx == newx && oldy == newy - 1)
 				return true;
 			else
 				return false;
@@ -975,21 +2005,21 @@ bool Chess::LegalMove(Move *m)
 }
 
 /****************************************************************************
- * Name:        GetRecentMove
- * Input:       index - int
+ * Name:        GetCaptured
+ * Input:       m - a move
  * Output:      None
- * Returns:     Move structure
- * Description: Returns a move from the list of the last 12, which one is
- *				determined by the index parameter.
+ * Returns:     int
+ * Description: Returns the piece the move would capture, or EMPTY.
  * Invokes:     None
- * Note:        None
+ * Note:        Only meaningful before the move is made.
  ***************************************************************************/
-Move Chess::GetRecentMove(int index)
+int Chess::GetCaptured(Move m)
 {
-	if (index < 0 || index > 11)
-		return last_12_moves[0];
+	// enpassant captures the pawn beside the destination
+	if (m.Enpassant())
+		return squares[SQUARE(m.NewX(), m.OldY())];
 
-	return last_12_moves[index];
+	return squares[m.To()];
 }
 
 /****************************************************************************
@@ -1074,5 +2104,135 @@ int Chess::GetState()
  ***************************************************************************/
 int Chess::GetNumPieces()
 {
-	return num_pieces;
+	return PopCount(occupied);
+}
+
+/****************************************************************************
+ * Name:        GetHalfmoveClock
+ * Input:       None
+ * Output:      None
+ * Returns:     int
+ * Description: Returns the number of halfmoves since the last capture or
+ *				pawn move.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+int Chess::GetHalfmoveClock()
+{
+	return halfmove_clock;
+}
+
+/****************************************************************************
+ * Name:        GetPieces
+ * Input:       piece - int
+ * Output:      None
+ * Returns:     Bitboard
+ * Description: This gets the set of squares holding the given piece.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+Bitboard Chess::GetPieces(int piece)
+{
+	return pieces[piece];
+}
+
+/****************************************************************************
+ * Name:        GetOccupancy
+ * Input:       player - int
+ * Output:      None
+ * Returns:     Bitboard
+ * Description: This gets the set of squares holding any of player's pieces.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+Bitboard Chess::GetOccupancy(int player)
+{
+	return occupancy[player];
+}
+
+/****************************************************************************
+ * Name:        GetHash
+ * Input:       None
+ * Output:      None
+ * Returns:     HashKey
+ * Description: Returns the Zobrist key of the current position.
+ * Invokes:     None
+ * Note:        The key is kept up to date by SimulateMove(),
+ *				UnSimulateMove() and FinalizeMove(), so this costs nothing.
+ ***************************************************************************/
+HashKey Chess::GetHash()
+{
+	return hash;
+}
+
+/****************************************************************************
+ * Name:        ComputeHash
+ * Input:       None
+ * Output:      None
+ * Returns:     HashKey
+ * Description: Builds the Zobrist key of the current position from the
+ *				board, castling flags, en passant column and turn.
+ * Invokes:     CastleHash()
+ * Note:        None
+ ***************************************************************************/
+HashKey Chess::ComputeHash()
+{
+	HashKey key = CastleHash();
+
+	for (int s = 0; s < 64; s++)
+		key ^= piece_keys[squares[s]][s];
+
+	if (enpassant_x >= 0)
+		key ^= enpassant_keys[enpassant_x];
+
+	if (turn == PLAYER_BLACK)
+		key ^= turn_key;
+
+	return key;
+}
+
+/****************************************************************************
+ * Name:        CastleHash
+ * Input:       None
+ * Output:      None
+ * Returns:     HashKey
+ * Description: Returns the keys of the castling flags that are still set
+ *				xor'd together.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+HashKey Chess::CastleHash()
+{
+	HashKey key = 0;
+
+	if (WhiteCastleLeft)
+		key ^= castle_keys[0];
+
+	if (WhiteCastleRight)
+		key ^= castle_keys[1];
+
+	if (BlackCastleLeft)
+		key ^= castle_keys[2];
+
+	if (BlackCastleRight)
+		key ^= castle_keys[3];
+
+	return key;
+}
+
+/****************************************************************************
+ * Name:        PawnBeside
+ * Input:       x, y - a square
+ *				pawn - PAWN_WHITE or PAWN_BLACK
+ * Output:      None
+ * Returns:     true if that pawn is on the square to the left or right
+ * Description: Tells whether a pawn that just stepped two squares to x, y
+ *				can be taken en passant by a pawn of the other color.
+ * Invokes:     None
+ * Note:        Doesn't check that taking it would be legal, a pinned pawn
+ *				still counts.
+ ***************************************************************************/
+bool Chess::PawnBeside(int x, int y, int pawn)
+{
+	return (x > 0 && squares[SQUARE(x - 1, y)] == pawn) || (x < 7 && squares[SQUARE(x + 1, y)] == pawn);
 }
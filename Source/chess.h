@@ -16,6 +16,9 @@
 #ifndef CHESS_H
 #define CHESS_H
 
+#include <map>
+#include <string>
+
 #define STATE_NORMAL	0
 #define STATE_CHECK		1
 #define STATE_CHECKMATE	2
@@ -40,54 +43,154 @@
 #define QUEEN_BLACK		15
 #define KING_BLACK		16
 
+// Enough room for every move in any reachable position
+#define MAX_MOVES		256
+
+// Deepest line of moves that can be simulated at once
+#define MAX_PLY			128
+
+// Number of position keys remembered for spotting repetitions.  Must be a
+// power of two, and more than the 100 halfmoves of the fifty move rule plus
+// MAX_PLY, since only positions since the last capture or pawn move count.
+#define HISTORY_SIZE	256
+
+// The board is held as a set of bitboards, one bit per tile.  Square n is
+// the tile at x = n % 8, y = n / 8, so bit 0 is the top left corner of the
+// board (black's queen side rook) and bit 63 is white's king side rook.
+typedef unsigned long long Bitboard;
+
+// A Zobrist key - a 64 bit number that stands in for a whole position
+typedef unsigned long long HashKey;
+
+#define SQUARE(x, y)	((y) * 8 + (x))
+#define SQUARE_X(s)		((s) & 7)
+#define SQUARE_Y(s)		((s) >> 3)
+#define SQUARE_BIT(s)	(1ULL << (s))
+
+// Bit twiddling helpers for walking the squares set in a bitboard
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+inline int PopCount(Bitboard b)
+{
+	return (int)__popcnt64(b);
+}
+
+inline int LowestSquare(Bitboard b)
+{
+	unsigned long index;
+	_BitScanForward64(&index, b);
+	return (int)index;
+}
+#else
+inline int PopCount(Bitboard b)
+{
+	return __builtin_popcountll(b);
+}
+
+inline int LowestSquare(Bitboard b)
+{
+	return __builtin_ctzll(b);
+}
+#endif
+
+// Returns the lowest set square and clears it from the bitboard
+inline int PopLowestSquare(Bitboard &b)
+{
+	int s = LowestSquare(b);
+	b &= b - 1;
+	return s;
+}
+
+
+// Special move flags stored in a Move
+#define MOVE_NORMAL		0
+#define MOVE_PROMOTION	1
+#define MOVE_CASTLE		2
+#define MOVE_ENPASSANT	3
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Name:        Move
-// Description: This structure holds all the data required for a move
-//		It also allows for
+// Description: This structure holds all the data required for a move,
+//		packed into 16 bits so move lists stay small and cheap to copy.
+//		Bits 0-5 are the starting square, bits 6-11 the destination,
+//		bits 12-13 the special move flag, and bits 14-15 what a pawn
+//		promotes to (counting down from the queen).  The moving and
+//		captured pieces are read off the board, not stored.
 /////////////////////////////////////////////////////////////////////////////
 struct Move
 {
-	int oldx, oldy;
-	int newx, newy;
+	unsigned short data;
 
-	int piece;
-	int captured;
+	Move()
+	{
+		data = 0;
+	}
 
-	bool castle;
-	bool promotion;
-	bool enpassant;
+	// promote is the piece a pawn turns into (either color), queen by default
+	Move(int from, int to, int flag = MOVE_NORMAL, int promote = QUEEN_WHITE)
+	{
+		data = (unsigned short)(from | (to << 6) | (flag << 12) | ((QUEEN_WHITE - promote % 10) << 14));
+	}
 
-	int value;
+	int From() const { return data & 63; }
+	int To() const { return (data >> 6) & 63; }
 
-	Move()
+	int OldX() const { return SQUARE_X(From()); }
+	int OldY() const { return SQUARE_Y(From()); }
+	int NewX() const { return SQUARE_X(To()); }
+	int NewY() const { return SQUARE_Y(To()); }
+
+	int Flag() const { return (data >> 12) & 3; }
+
+	bool Castle() const { return Flag() == MOVE_CASTLE; }
+	bool Promotion() const { return Flag() == MOVE_PROMOTION; }
+	bool Enpassant() const { return Flag() == MOVE_ENPASSANT; }
+
+	// The piece a pawn promotes to, given as the white piece
+	int Promoted() const { return QUEEN_WHITE - (data >> 14); }
+
+	void SetFlag(int flag)
 	{
-		oldx = oldy = newx = newy = 0;
+		data = (unsigned short)((data & ~(3 << 12)) | (flag << 12));
 	}
 
-	bool operator == (Move &m)
+	bool operator == (const Move &m) const
 	{
-		if (oldx == m.oldx && oldy == m.oldy && newx == m.newx && newy == m.newy && piece == m.piece)
-		{
-			return true;
-		}
-
-		return false;
+		return data == m.data;
 	}
 };
 
+// What SimulateMove() changes that UnSimulateMove() can't work out from
+// the move itself - everything needed to put the position back exactly
+struct Undo
+{
+	int captured;
+	int halfmove_clock;
+	int enpassant_x;
+	bool WhiteCastleLeft;
+	bool WhiteCastleRight;
+	bool BlackCastleLeft;
+	bool BlackCastleRight;
+	HashKey hash;
+};
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Name:        Chess
 // Description: This class handles all the gameplay and mechanics of the
 //		chess game.  It also is the primary class that all other
-//		classes reference.
+//		classes reference.  Everything about a position lives in the
+//		object itself (the attack tables and hash keys are shared, but
+//		never change once built), so a copy is a separate board that
+//		another thread can search.
 /////////////////////////////////////////////////////////////////////////////
 class Chess
 {
 	public:
 
-		// Default constructor - does nothing
+		// Default constructor - builds the attack tables
 		Chess();
 
 		// Destructor - does nothing
@@ -96,11 +199,32 @@ class Chess
 		// Sets up a new game of chess
 		void Init();
 
+		// Sets up the position described by a FEN string
+		bool LoadFEN(const std::string &fen);
+
+		// Describes the current position as a FEN string
+		std::string GetFEN();
+
+		// Sets up the position from an EPD line, filling in its opcodes
+		bool LoadEPD(const std::string &epd, std::map<std::string, std::string> &opcodes);
+
+		// Describes the current position as an EPD line with the given opcodes
+		std::string GetEPD(const std::map<std::string, std::string> &opcodes);
+
 		// Checks if a given move is legal or not
 		bool LegalMove(Move *m);
 
-		// Generates a list of moves for the given player
-		int GenerateMoves(Move *move_list, int player);
+		// Generates a list of moves for the given player, or just the first
+		// one found if that's all that is needed, or only the captures and
+		// promotions
+		int GenerateMoves(Move *move_list, int player, bool first_only = false, bool captures_only = false);
+
+		// Returns true if any of player's pieces attack the given square
+		bool SquareAttacked(int square, int player);
+
+		// Gets the bitboard of player's pieces attacking the given square,
+		// as if only the squares in blockers were occupied
+		Bitboard Attackers(int square, int player, Bitboard blockers);
 
 		// Returns true if player is in check
 		bool InCheck(int player);
@@ -111,19 +235,36 @@ class Chess
 		// Checks if the game is in a stalemate configuration
 		bool Stalemate();
 
-		// Makes a move
+		// Counts how many times the current position has come up before
+		int Repetitions();
+
+		// Returns the number of halfmoves since the last capture or pawn move
+		int GetHalfmoveClock();
+
+		// Makes a move, including castling, en passant and the turn
 		void SimulateMove(Move *m);
 
-		// Unmakes a move
+		// Unmakes a move, putting everything back as it was
 		void UnSimulateMove(Move *m);
 
-		// Sets flags for castling and recent moves after a move is made
+		// Passes the turn to the other player without moving, for the search
+		void SimulateNullMove();
+
+		// Takes back a pass
+		void UnSimulateNullMove();
+
+		// Marks a move as played for good, so it can no longer be undone
 		void FinalizeMove(Move *m);
 
-		// Updates the state of the game
-		// Also toggles the turn
+		// Updates the state of the game for the player to move
 		void Update();
 
+		// Works out whether player is in check, checkmate or stalemate
+		int Classify(int player);
+
+		// Returns the piece a move would capture (before it is made)
+		int GetCaptured(Move m);
+
 		// Returns true if a piece belongs to white
 		bool WhitePiece(int piece);
 
@@ -133,9 +274,6 @@ class Chess
 		// Puts a piece on the board at a given location "by hand"
 		void ReplaceBoard(int piece, int x, int y);
 
-		// Gets a recent move at the specified index
-		Move GetRecentMove(int index);
-
 		// Gets the piece at position x,y of the board
 		int GetBoard(int x, int y);
 
@@ -148,6 +286,18 @@ class Chess
 		// Returns the total number of pieces on the board
 		int GetNumPieces();
 
+		// Gets the bitboard of every square holding the given piece
+		Bitboard GetPieces(int piece);
+
+		// Gets the bitboard of every square holding one of player's pieces
+		Bitboard GetOccupancy(int player);
+
+		// Returns the Zobrist key of the current position
+		HashKey GetHash();
+
+		// Works the Zobrist key out from scratch (slow, for checking GetHash)
+		HashKey ComputeHash();
+
 	protected:
 
 		// Changes a variable to its absolute value
@@ -155,17 +305,64 @@ class Chess
 
 		// Changes the turn to the opponent's turn
 		void ToggleTurn();
+
+		// Puts a piece on an empty square, updating every bitboard
+		void PutPiece(int piece, int square);
+
+		// Takes whatever piece is on a square off the board
+		void RemovePiece(int square);
+
+		// Clears the board of all pieces
+		void ClearBoard();
+
+		// Sets up a position from the fields shared by FEN and EPD
+		bool SetPosition(const std::string &board, const std::string &side, const std::string &castling,
+						 const std::string &enpassant, int halfmoves, int fullmoves);
+
+		// Writes the board, side, castling and en passant fields of FEN/EPD
+		std::string PositionFields();
+
+		// Returns the part of the Zobrist key that covers the castling flags
+		HashKey CastleHash();
+
+		// Returns true if a given pawn stands either side of a square
+		bool PawnBeside(int x, int y, int pawn);
+
+		// Appends a move from a square to each square in targets
+		void AddMoves(Move *move_list, int &num, int from, Bitboard targets);
+
+		// Appends all four promotions from a square to each square in targets
+		void AddPromotions(Move *move_list, int &num, int from, Bitboard targets);
 	
-		// Keeps track of the board
-		int board[8][8];
+		// Keeps track of the board - one bitboard for each piece type
+		// (indexed by the piece defines above), one for each player,
+		// and one for every occupied square
+		Bitboard pieces[KING_BLACK + 1];
+		Bitboard occupancy[2];
+		Bitboard occupied;
+
+		// The piece on each square, kept in step with the bitboards so
+		// that single square lookups don't have to search for the piece
+		int squares[64];
 
 		int num_players;	// Number of players playing
-		int num_pieces;		// Number of pieces on the board
 		int turn;			// Whose turn it is
 		int game_state;		// The state of the game
 
-		// Keeps track of the last 12 moves made
-		Move last_12_moves[12];
+		// Keys of the positions played and simulated so far, used as a
+		// ring buffer - history_count is the total ever pushed
+		HashKey history[HISTORY_SIZE];
+		int history_count;
+
+		// Halfmoves since the last capture or pawn move
+		int halfmove_clock;
+
+		// Starts at 1 and goes up after each of black's moves
+		int fullmove_number;
+
+		// Undo records for the moves simulated but not yet finalized
+		Undo undo_stack[MAX_PLY];
+		int undo_count;
 
 		// Keep track of the availability of castling
 		bool WhiteCastleLeft;
@@ -173,6 +370,13 @@ class Chess
 		bool BlackCastleLeft;
 		bool BlackCastleRight;
 
+		// The column a pawn just double stepped on, or -1 if there isn't one
+		// or no enemy pawn is beside it to take it
+		int enpassant_x;
+
+		// Zobrist key of the position, kept up to date as pieces move
+		HashKey hash;
+
 };
 
 #endif
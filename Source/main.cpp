@@ -16,8 +16,12 @@
 //===========================================================================
 
 #include <GLUT/glut.h>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <chrono>
+#include <future>
+#include <thread>
 #include "sound.h"
 #include "geometry.h"
 #include "chess.h"
@@ -28,6 +32,11 @@
 #define UI_CHOOSE	1
 #define UI_PROMOTE	2
 
+// Least time from a bot starting to think to its move being made, and how
+// long to wait between looks at whether the search is done (milliseconds)
+#define BOT_PAUSE	1000
+#define BOT_POLL	10
+
 // The rotation matrix for the view (initial values are set
 // to give a nice, "isometric" looking angle)
 double	rot[16] = { 0.82, -0.33, 0.45, 0.0 ,
@@ -70,6 +79,24 @@ bool BlackHuman = false;
 bot bot_white;
 bot bot_black;
 
+// The bot search running on the worker thread, if there is one - the bot,
+// its own copy of the board, the flag that cancels it and when it started
+std::future<SearchResult> search;
+bot *search_bot = NULL;
+Chess search_board;
+std::atomic<bool> search_cancel(false);
+std::chrono::steady_clock::time_point search_start;
+
+// Whether the search is pondering on the opponent's time, the hash key of
+// the position it ponders on (the worker is busy with its board, so it is
+// kept here), and the flag that tells it the opponent made the move it guessed
+bool search_pondering = false;
+HashKey ponder_key = 0;
+std::atomic<bool> ponder_hit(false);
+
+// Makes a bot's move once its search is done
+void BotIdleCB();
+
 // For testing we keep track of total moves made
 int numWhiteMoves = 0;
 int numBlackMoves = 0;
@@ -139,21 +166,13 @@ void ReshapeCB(int w, int h)
 }
 
 /****************************************************************************
- * Name:        ReshapeCB
+ * Name:        TimerCB
  * Input:       value - integer that functions as the "id" of the callback
  * Output:      None
  * Returns:     None
- * Description: Handles timer callback events.  This includes stopping the display
- *				of a given text message, and more imporantly it handles making
- *				the next AI move.
- * Invokes:     SimulateMove() - from the chess class
- *				FinalizeMove() - from the chess class
- *				Update() - from the chess class
- *				OutputStatus()
- *				GetState() - from the chess class
- *				GetTurn() - from the chess class
- *				run() - from the bot class
- *				playSound() - from the sound class
+ * Description: Handles timer callback events, which is stopping the display
+ *				of a given text message.
+ * Invokes:     None
  * Note:        None
  ***************************************************************************/
 void TimerCB(int value)
@@ -165,75 +184,225 @@ void TimerCB(int value)
 	// 0 value indicates we just want to stop displaying some message
 	if (value == 0)
 		display_output = false;
+}
 
-	// 1 value means we want the white bot to make a move
-	else if (value == 1 && chess.GetTurn() == PLAYER_WHITE && !WhiteHuman)
+/****************************************************************************
+ * Name:        StopBot
+ * Input:       pBot - the bot to stop, NULL for either
+ * Output:      None
+ * Returns:     None
+ * Description: Cancels the running search if it is the given bot's, and
+ *				waits for the worker thread to give up.  Its move is thrown
+ *				away.
+ * Invokes:     None
+ * Note:        Has to be called before the board is reset or the bot is
+ *				changed under a search.  The search only looks at the
+ *				cancel flag every so often, so the wait is short.
+ ***************************************************************************/
+void StopBot(bot *pBot)
+{
+	if (!search.valid() || (pBot && pBot != search_bot))
+		return;
+
+	search_cancel = true;
+	search.wait();
+	search = std::future<SearchResult>();
+	search_bot = NULL;
+	search_pondering = false;
+
+	glutIdleFunc(NULL);
+}
+
+/****************************************************************************
+ * Name:        StartBot
+ * Input:       player - PLAYER_WHITE or PLAYER_BLACK
+ * Output:      None
+ * Returns:     None
+ * Description: Starts the player's bot searching for its move, if it is the
+ *				player's turn and a bot plays for it.  The search runs on a
+ *				worker thread, on a copy of the board, so the window keeps
+ *				drawing and taking input while it thinks; BotIdleCB() makes
+ *				the move once the search is done.  If the bot has been
+ *				pondering on this very position, that search just carries
+ *				on; a search pondering on any other position is stopped.
+ * Invokes:     run() - from the bot class, on the worker thread
+ *				GetState() - from the chess class
+ *				GetTurn() - from the chess class
+ *				GetHash() - from the chess class
+ *				StopBot()
+ * Note:        Does nothing if a search is already running.
+ ***************************************************************************/
+void StartBot(int player)
+{
+	// Do nothing if the game is over, but stop any pondering
+	if (chess.GetState() == STATE_CHECKMATE || chess.GetState() == STATE_STALEMATE)
 	{
-		// Run the bot search
-		animated_move = bot_white.run(&chess);
-		
-		// Make the move
-		chess.SimulateMove(&animated_move);
+		StopBot(NULL);
+		return;
+	}
 
-		// Finalize the move
-		chess.FinalizeMove(&animated_move);
+	if (chess.GetTurn() != player)
+		return;
 
-		// Increment white moves (for testing)
-		numWhiteMoves++;
+	bot *pBot;
 
-		// play the appropriate sound
-		if (animated_move.captured == EMPTY)
-			sound.playSound("Audio/Move.wav", false);
-		else
-			sound.playSound("Audio/Capture.wav", false);
+	if (player == PLAYER_WHITE && !WhiteHuman)
+		pBot = &bot_white;
+	else if (player == PLAYER_BLACK && !BlackHuman)
+		pBot = &bot_black;
+	else
+		return;
 
-		// Update the game status
-		chess.Update();
-		// Output any necessary status messages
-		OutputStatus();
+	if (search.valid())
+	{
+		if (!search_pondering)
+			return;
 
-		// Redraw the scene
-		glutPostRedisplay();
+		// The opponent made the move the bot guessed
+		if (search_bot == pBot && ponder_key == chess.GetHash())
+		{
+			search_pondering = false;
+			search_start = std::chrono::steady_clock::now();
+			ponder_hit = true;
 
-		// If black is an AI, register another timer callback
-		if (!BlackHuman)
-			glutTimerFunc(1000, TimerCB, 2);
+			glutIdleFunc(BotIdleCB);
+			return;
+		}
+
+		StopBot(NULL);
+	}
+
+	search_bot = pBot;
+	search_board = chess;
+	search_cancel = false;
+	search_start = std::chrono::steady_clock::now();
+
+	search = std::async(std::launch::async, &bot::run, search_bot, &search_board, &search_cancel,
+						(const std::atomic<bool> *)NULL);
 
+	glutIdleFunc(BotIdleCB);
+}
+
+/****************************************************************************
+ * Name:        StartPonder
+ * Input:       pBot - the bot that just moved
+ * Output:      None
+ * Returns:     None
+ * Description: If the bot ponders, starts it searching on the opponent's
+ *				time, on the position after the reply its last search
+ *				expects.  StartBot() picks the search up if the opponent
+ *				makes that move.
+ * Invokes:     run() - from the bot class, on the worker thread
+ *				ponders() - from the bot class
+ *				getPonderMove() - from the bot class
+ *				SimulateMove() - from the chess class
+ *				FinalizeMove() - from the chess class
+ *				GetHash() - from the chess class
+ * Note:        Does nothing if a search is already running.
+ ***************************************************************************/
+void StartPonder(bot *pBot)
+{
+	if (chess.GetState() == STATE_CHECKMATE || chess.GetState() == STATE_STALEMATE)
+		return;
+
+	Move guess = pBot->getPonderMove();
+
+	if (search.valid() || !pBot->ponders() || guess == Move())
+		return;
+
+	search_bot = pBot;
+	search_board = chess;
+	search_board.SimulateMove(&guess);
+	search_board.FinalizeMove(&guess);
+	ponder_key = search_board.GetHash();
+	search_cancel = false;
+	search_pondering = true;
+	ponder_hit = false;
+
+	search = std::async(std::launch::async, &bot::run, search_bot, &search_board, &search_cancel,
+						&ponder_hit);
+}
+
+/****************************************************************************
+ * Name:        BotIdleCB
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Idle callback while a bot is searching - once the search is
+ *				done, and at least BOT_PAUSE milliseconds after it started,
+ *				makes the move the bot found and starts the other bot if
+ *				there is one.
+ * Invokes:     SimulateMove() - from the chess class
+ *				FinalizeMove() - from the chess class
+ *				Update() - from the chess class
+ *				GetTurn() - from the chess class
+ *				OutputStatus()
+ *				StartBot()
+ *				StartPonder()
+ *				playSound() - from the sound class
+ * Note:        Sleeps a little between looks at the search, so the idle
+ *				loop doesn't take a core away from it.
+ ***************************************************************************/
+void BotIdleCB()
+{
+	if (!search.valid())
+	{
+		glutIdleFunc(NULL);
+		return;
 	}
 
-	// 2 value means we want the black bot to make a move
-	else if (value == 2 && chess.GetTurn() == PLAYER_BLACK && !BlackHuman)
+	if (search.wait_for(std::chrono::milliseconds(BOT_POLL)) != std::future_status::ready)
+		return;
+
+	// Pause between moves so people can follow the game (the bot thinks
+	// during it, so a slow search isn't held up any longer)
+	if (std::chrono::steady_clock::now() - search_start < std::chrono::milliseconds(BOT_PAUSE))
 	{
-		// Run the bot search
-		animated_move = bot_black.run(&chess);
+		std::this_thread::sleep_for(std::chrono::milliseconds(BOT_POLL));
+		return;
+	}
+
+	// Get the bot's move
+	bot *pBot = search_bot;
 
-		// Make the move
-		chess.SimulateMove(&animated_move);
+	animated_move = search.get().move;
+	search_bot = NULL;
 
-		// Finalize the move
-		chess.FinalizeMove(&animated_move);
+	glutIdleFunc(NULL);
 
-		// Increment black moves (for testing)
+	// Note what it takes before making the move
+	int captured = chess.GetCaptured(animated_move);
+
+	// Make the move
+	chess.SimulateMove(&animated_move);
+
+	// Finalize the move
+	chess.FinalizeMove(&animated_move);
+
+	// Increment the moves made (for testing)
+	if (chess.GetTurn() == PLAYER_BLACK)
+		numWhiteMoves++;
+	else
 		numBlackMoves++;
 
-		// play the appropriate sound
-		if (animated_move.captured == EMPTY)
-			sound.playSound("Audio/Move.wav", false);
-		else
-			sound.playSound("Audio/Capture.wav", false);
+	// play the appropriate sound
+	if (captured == EMPTY)
+		sound.playSound("Audio/Move.wav", false);
+	else
+		sound.playSound("Audio/Capture.wav", false);
 
-		// Update the game status
-		chess.Update();
-		// Output any necessary status messages
-		OutputStatus();
+	// Update the game status
+	chess.Update();
+	// Output any necessary status messages
+	OutputStatus();
 
-		// Redraw the scene
-		glutPostRedisplay();
+	// Redraw the scene
+	glutPostRedisplay();
 
-		// If white is an AI, register another timer callback
-		if (!WhiteHuman)
-			glutTimerFunc(1000, TimerCB, 1);;
-	}
+	// If the other side is an AI, start it thinking, otherwise think on the
+	// opponent's time
+	StartBot(chess.GetTurn());
+	StartPonder(pBot);
 }
 
 /****************************************************************************
@@ -432,7 +601,9 @@ void OutputStatus()
  * Output:      None
  * Returns:     None
  * Description: Handles mouse clicks.
- * Invokes:     ReplaceBoard() - from the chess class
+ * Invokes:     GetCaptured() - from the chess class
+ *				SimulateMove() - from the chess class
+ *				FinalizeMove() - from the chess class
  *				OutputStatus()
  *				GetTurn() - from the chess class
  *				Update() - from the chess class
@@ -450,52 +621,50 @@ void MouseFuncCB(int button, int state, int x, int y)
 			if (y < 230 || y > 295)
 				return;
 
-			// White promotion
-			if (chess.GetTurn() == PLAYER_WHITE)
-			{
-				if (x > 280 && x < 340)
-					chess.ReplaceBoard(ROOK_WHITE, animated_move.newx, animated_move.newy);
-				else if (x > 350 && x < 410)
-					chess.ReplaceBoard(KNIGHT_WHITE, animated_move.newx, animated_move.newy);
-				else if (x > 415 && x < 480)
-					chess.ReplaceBoard(BISHOP_WHITE, animated_move.newx, animated_move.newy);
-				else if (x > 485 && x < 550)
-					chess.ReplaceBoard(QUEEN_WHITE, animated_move.newx, animated_move.newy);
-				else
-					return;
-			}
-			
-			// Black promotion
+			// The move only records the kind of piece, its color comes from the pawn
+			int piece;
+
+			if (x > 280 && x < 340)
+				piece = ROOK_WHITE;
+			else if (x > 350 && x < 410)
+				piece = KNIGHT_WHITE;
+			else if (x > 415 && x < 480)
+				piece = BISHOP_WHITE;
+			else if (x > 485 && x < 550)
+				piece = QUEEN_WHITE;
 			else
-			{
-				if (x > 280 && x < 340)
-					chess.ReplaceBoard(ROOK_BLACK, animated_move.newx, animated_move.newy);
-				else if (x > 350 && x < 410)
-					chess.ReplaceBoard(KNIGHT_BLACK, animated_move.newx, animated_move.newy);
-				else if (x > 415 && x < 480)
-					chess.ReplaceBoard(BISHOP_BLACK, animated_move.newx, animated_move.newy);
-				else if (x > 485 && x < 550)
-					chess.ReplaceBoard(QUEEN_BLACK, animated_move.newx, animated_move.newy);
-				else
-					return;
-			}
+				return;
+
+			// Now that we know what the pawn becomes, make the move
+			animated_move = Move(animated_move.From(), animated_move.To(), MOVE_PROMOTION, piece);
+
+			int captured = chess.GetCaptured(animated_move);
+
+			chess.SimulateMove(&animated_move);
+			chess.FinalizeMove(&animated_move);
+
+			// Play the appropriate sound
+			if (captured == EMPTY)
+				sound.playSound("Audio/Move.wav", false);
+			else
+				sound.playSound("Audio/Capture.wav", false);
 
 			// Reset the UI mode back to normal
 			UImode = UI_NORMAL;
 			// Update the state
 			chess.Update();
 
-			// Start bot timers if necessary
+			// Start the bot if necessary
 			if (chess.GetTurn() == PLAYER_WHITE)
 			{
 				if (!WhiteHuman)
-					glutTimerFunc(1000, TimerCB, 1);
+					StartBot(PLAYER_WHITE);
 			}
 
 			else
 			{
 				if (!BlackHuman)
-					glutTimerFunc(1000, TimerCB, 2);
+					StartBot(PLAYER_BLACK);
 			}
 
 			// Output the status of the game
@@ -671,9 +840,9 @@ void SpecialCB(int key, int x, int y)
  *				GetTurn() - from chess class
  *				playSound() - from sound class
  *				LegalMove() - from chess class
+ *				GenerateMoves() - from chess class
  *				Message()
  *				SimulateMove() - from chess class
- *				UnSimulateMove() - from chess class
  *				FinalizeMove() - from chess class
  * Note:        Normally, pressing enter will select the piece at the cursor's
  *				location.  The UI then goes into "select" mode where the next
@@ -745,58 +914,58 @@ void KeyboardCB(unsigned char key, int x, int y)
 		else if (UImode == UI_CHOOSE)
 		{
 			// Setup a move structure to check if it's legal
-			animated_move.oldx = pick_x;
-			animated_move.oldy = pick_y;
-			animated_move.newx = curs_x;
-			animated_move.newy = curs_y;
-
-			animated_move.piece = chess.GetBoard(pick_x, pick_y);
-			animated_move.captured = chess.GetBoard(curs_x, curs_y);
+			animated_move = Move(SQUARE(pick_x, pick_y), SQUARE(curs_x, curs_y));
 
 			// If it's a legal move, try to make it
 			if (chess.LegalMove(&animated_move))
 			{
-				// Special case, can't castle out of check
-				if (animated_move.castle)
+				// The piece can move there, but the king has to be safe
+				// afterwards too - only the generated moves make sure of that
+				Move legal_moves[MAX_MOVES];
+				int num_legal = chess.GenerateMoves(legal_moves, chess.GetTurn());
+				bool safe = false;
+
+				for (int i = 0; i < num_legal; i++)
 				{
-					if (chess.GetState() == STATE_CHECK)
-					{
-						Message("You can't castle out of check");
-						sound.playSound("Audio/IllegalMove.wav", false);
-						glutPostRedisplay();
-						return;
-					}
+					if (legal_moves[i].From() == animated_move.From() && legal_moves[i].To() == animated_move.To())
+						safe = true;
 				}
 
-				// Try making the move
-				chess.SimulateMove(&animated_move);
-
-				// Don't allow moving into check
-				if (chess.InCheck(chess.GetTurn()))
+				if (!safe)
 				{
-					Message("You can't move into check");
-					chess.UnSimulateMove(&animated_move);
+					if (animated_move.Castle() && chess.GetState() == STATE_CHECK)
+						Message("You can't castle out of check");
+					else if (animated_move.Castle())
+						Message("You can't castle through check");
+					else
+						Message("You can't move into check");
+
 					sound.playSound("Audio/IllegalMove.wav", false);
 					glutPostRedisplay();
 					return;
 				}
 
-				// Legal move, finalize it
-				chess.FinalizeMove(&animated_move);
+				// Note what it takes before making the move
+				int captured = chess.GetCaptured(animated_move);
 
-				// Play the appropriate sound
-				if (animated_move.captured == EMPTY)
-					sound.playSound("Audio/Move.wav", false);
-				else
-					sound.playSound("Audio/Capture.wav", false);
-
-				// New UI state if we need to promote the piece
-				if (animated_move.promotion)
+				// New UI state if we need to promote the piece, the move is
+				// made once the player picks what the pawn becomes
+				if (animated_move.Promotion())
 					UImode = UI_PROMOTE;
 
 				// Otherwise proceed normally
 				else
 				{
+					// Legal move, make it and finalize it
+					chess.SimulateMove(&animated_move);
+					chess.FinalizeMove(&animated_move);
+
+					// Play the appropriate sound
+					if (captured == EMPTY)
+						sound.playSound("Audio/Move.wav", false);
+					else
+						sound.playSound("Audio/Capture.wav", false);
+
 					// UI mode goes back to normal
 					UImode = UI_NORMAL;
 					// Update the game status
@@ -809,13 +978,13 @@ void KeyboardCB(unsigned char key, int x, int y)
 					if (chess.GetTurn() == PLAYER_WHITE)
 					{
 						if (!WhiteHuman)
-							glutTimerFunc(1000, TimerCB, 1);
+							StartBot(PLAYER_WHITE);
 					}
 
 					else
 					{
 						if (!BlackHuman)
-							glutTimerFunc(1000, TimerCB, 2);
+							StartBot(PLAYER_BLACK);
 					}
 				}
 
@@ -845,10 +1014,22 @@ void KeyboardCB(unsigned char key, int x, int y)
  * Invokes:     Init() - chess class
  *				Message()
  *				LoadAI() - bot class
+ *				newGame() - bot class
+ *				StartBot()
+ *				StopBot()
  * Note:        This menu should be attached to the right mouse button.
  ***************************************************************************/
 void MenuCB(int value)
 {
+	// Stop any search the board or the bot is about to change under - on a
+	// new game or exit, or when the side searching changes hands
+	if (value == 100 || value == 101)
+		StopBot(NULL);
+	else if (value >= 0 && value <= 8 && value != 5)
+		StopBot(&bot_white);
+	else if (value >= 10 && value <= 18 && value != 15)
+		StopBot(&bot_black);
+
 	switch(value)
 	{
 		// "New Game"
@@ -863,10 +1044,14 @@ void MenuCB(int value)
 			// Re-initialize the chess board
 			chess.Init();
 			Message("White plays first");
+
+			// Start the bots' clocks over
+			bot_white.newGame();
+			bot_black.newGame();
 			
 			// If white is a bot, start it
 			if (!WhiteHuman)
-				glutTimerFunc(3000, TimerCB, 1);
+				StartBot(PLAYER_WHITE);
 			
 			glutPostRedisplay();
 		break;
@@ -891,7 +1076,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		// "White --> riha.bot"
@@ -903,7 +1088,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		// "White --> justin.bot"
@@ -915,7 +1100,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		// "White --> jc.bot"
@@ -927,7 +1112,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		case 6:
@@ -937,7 +1122,7 @@ void MenuCB(int value)
 			// If testing			
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		case 7:
@@ -947,7 +1132,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		case 8:
@@ -957,7 +1142,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_white.printBotValues();
 			WhiteHuman = false;
-			glutTimerFunc(1000, TimerCB, 1);
+			StartBot(PLAYER_WHITE);
 		break;
 
 		// "Black --> Player"
@@ -973,7 +1158,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			//glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		// "Black --> riha.bot"
@@ -984,7 +1169,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		// "Black --> justin.bot"
@@ -995,7 +1180,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 		
 		// "Black --> jc.bot"
@@ -1006,7 +1191,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		case 16:
@@ -1016,7 +1201,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		case 17:
@@ -1026,7 +1211,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		case 18:
@@ -1036,7 +1221,7 @@ void MenuCB(int value)
 			// If testing
 			//bot_black.printBotValues();
 			BlackHuman = false;
-			glutTimerFunc(1000, TimerCB, 2);
+			StartBot(PLAYER_BLACK);
 		break;
 
 		// "Music --> On"
@@ -1176,12 +1361,35 @@ void InitOpenGL()
  *				Init() - chess class
  *				Message()
  *				playMusic() - sound class
+ *				setDefaultHashSize(), setDefaultSeed() - bot class
+ *				loadDefault() - bot class
  * Note:        None
  ***************************************************************************/
 int main(int argc, char* argv[])
 {
 	// Let the glut look at the arguments first
 	glutInit(&argc, argv);
+
+	// "-hash <MB>" sets the transposition table size for every bot that
+	// doesn't pick its own, "-seed <n>" the bots' random numbers - without
+	// it they come from the time, and the seed is printed so a game can be
+	// played again
+	unsigned long long seed = (unsigned long long)time(NULL);
+
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "-hash") == 0)
+			bot::setDefaultHashSize(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "-seed") == 0)
+			seed = strtoull(argv[i + 1], NULL, 10);
+	}
+
+	cout << "Seed: " << seed << endl;
+
+	// The bots were made before the seed was known
+	bot::setDefaultSeed(seed);
+	bot_white.loadDefault();
+	bot_black.loadDefault();
 	
 	// Initialize opengl
 	InitOpenGL();
@@ -1192,7 +1400,8 @@ int main(int argc, char* argv[])
 	// Initialize the chess class
 	chess.Init();
 
-	// Seed the random number generator
+	// Seed the random number generator (for the disco lights, the bots
+	// have their own)
 	srand(time(NULL));
 
 	Message("White plays first");
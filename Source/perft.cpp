@@ -0,0 +1,317 @@
+//===========================================================================
+//
+//  File name ......: perft.cpp
+//  Author(s) ......: Team Girella (perft)
+//  Language .......: C++
+//  Started ........: October 17, 2026
+//  Last modified ..: October 17, 2026
+//  Version ........: 1.0
+//  Source Path ....: .
+//  Operating System: Linux, Windows
+//  Purpose ........: Command line tool that counts every line of play to a
+//			given depth (perft).  The counts check the move generator
+//			against known results, and the time taken measures its
+//			speed.  Only needs chess.cpp, no graphics or sound.
+//
+//			perft <depth> [fen]           count from the start or a FEN
+//			perft divide <depth> [fen]    count under each first move
+//			perft suite [depth]           check the reference positions
+//
+//===========================================================================
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "chess.h"
+using namespace std;
+
+#define START_FEN	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// A position with its known perft counts, nodes[0] being depth 1
+struct PerftPosition
+{
+	const char *name;
+	const char *fen;
+	int depth;
+	long long nodes[5];
+};
+
+// The usual reference positions - between them they cover castling (and
+// losing the right to), en passant, promotions, pins and discovered checks
+static const PerftPosition suite[] =
+{
+	{ "start", START_FEN,
+	  5, { 20, 400, 8902, 197281, 4865609 } },
+	{ "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	  4, { 48, 2039, 97862, 4085603 } },
+	{ "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	  5, { 14, 191, 2812, 43238, 674624 } },
+	{ "promotions", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	  4, { 6, 264, 9467, 422333 } },
+	{ "talkchess", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	  4, { 44, 1486, 62379, 2103487 } },
+	{ "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	  4, { 46, 2079, 89890, 3894594 } },
+};
+
+/****************************************************************************
+ * Name:        GetSeconds
+ * Input:       None
+ * Output:      None
+ * Returns:     the time in seconds from a fixed starting point
+ * Description: Reads the steady clock, which never jumps like the wall clock.
+ * Invokes:     None
+ * Note:        Only the difference between two calls means anything.
+ ***************************************************************************/
+static double GetSeconds()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/****************************************************************************
+ * Name:        MoveName
+ * Input:       m - a move
+ * Output:      None
+ * Returns:     the move in coordinate notation, for example "e2e4" or "e7e8q"
+ * Description: Names the squares a move goes from and to.
+ * Invokes:     None
+ * Note:        Row y = 0 is black's back row, the 8th rank.
+ ***************************************************************************/
+static string MoveName(Move m)
+{
+	string name;
+
+	name += (char)('a' + m.OldX());
+	name += (char)('8' - m.OldY());
+	name += (char)('a' + m.NewX());
+	name += (char)('8' - m.NewY());
+
+	if (m.Promotion())
+		name += " prnbqk"[m.Promoted()];
+
+	return name;
+}
+
+/****************************************************************************
+ * Name:        Perft
+ * Input:       chess - the position to count from
+ *				depth - how many moves deep to go
+ * Output:      None
+ * Returns:     the number of lines of play exactly depth moves long
+ * Description: Makes every move, counts the lines below it, and unmakes it.
+ * Invokes:     GenerateMoves() - from the chess class
+ *				SimulateMove() - from the chess class
+ *				UnSimulateMove() - from the chess class
+ * Note:        The generator only gives legal moves, so one move from the
+ *				end the size of the list is the count - no need to make them.
+ ***************************************************************************/
+static long long Perft(Chess &chess, int depth)
+{
+	Move move_list[MAX_MOVES];
+	int num_moves = chess.GenerateMoves(move_list, chess.GetTurn());
+
+	if (depth <= 1)
+		return (depth == 1 ? num_moves : 1);
+
+	long long nodes = 0;
+
+	for (int i = 0; i < num_moves; i++)
+	{
+		chess.SimulateMove(&move_list[i]);
+		nodes += Perft(chess, depth - 1);
+		chess.UnSimulateMove(&move_list[i]);
+	}
+
+	return nodes;
+}
+
+/****************************************************************************
+ * Name:        Divide
+ * Input:       chess - the position to count from
+ *				depth - how many moves deep to go
+ * Output:      One line per legal move with the count below it
+ * Returns:     the total number of lines of play
+ * Description: The same count as Perft(), broken down by the first move, so
+ *				a wrong total can be chased down to the move at fault by
+ *				comparing with another program.
+ * Invokes:     Perft()
+ *				MoveName()
+ * Note:        None
+ ***************************************************************************/
+static long long Divide(Chess &chess, int depth)
+{
+	Move move_list[MAX_MOVES];
+	int num_moves = chess.GenerateMoves(move_list, chess.GetTurn());
+	long long total = 0;
+
+	for (int i = 0; i < num_moves; i++)
+	{
+		chess.SimulateMove(&move_list[i]);
+		long long nodes = Perft(chess, depth - 1);
+		chess.UnSimulateMove(&move_list[i]);
+
+		cout << MoveName(move_list[i]) << ": " << nodes << endl;
+		total += nodes;
+	}
+
+	cout << endl << "Moves: " << num_moves << endl;
+
+	return total;
+}
+
+/****************************************************************************
+ * Name:        Report
+ * Input:       nodes - number of lines counted
+ *				seconds - time it took
+ * Output:      The count, the time, and nodes per second
+ * Returns:     None
+ * Description: Prints the result of a count.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+static void Report(long long nodes, double seconds)
+{
+	cout << "Nodes: " << nodes << endl;
+	cout << "Time: " << seconds << " s" << endl;
+
+	if (seconds > 0)
+		cout << "NPS: " << (long long)(nodes / seconds) << endl;
+}
+
+/****************************************************************************
+ * Name:        RunSuite
+ * Input:       max_depth - deepest level to check, 0 for each position's own
+ * Output:      A line for every position and depth checked
+ * Returns:     the number of counts that didn't match, plus positions that
+ *				wouldn't load
+ * Description: Counts every reference position at each depth and compares
+ *				with the known result.
+ * Invokes:     LoadFEN() - from the chess class
+ *				Perft()
+ *				Report()
+ * Note:        A position that won't load counts as one failure.
+ ***************************************************************************/
+static int RunSuite(int max_depth)
+{
+	Chess chess;
+	int failures = 0;
+	long long total = 0;
+	double start = GetSeconds();
+
+	for (size_t p = 0; p < sizeof(suite) / sizeof(suite[0]); p++)
+	{
+		int depth = suite[p].depth;
+
+		if (max_depth > 0 && max_depth < depth)
+			depth = max_depth;
+
+		// A position that won't load would be counted on whatever board
+		// was left from the last one
+		if (!chess.LoadFEN(suite[p].fen))
+		{
+			cout << "FAILED " << suite[p].name << ": bad FEN " << suite[p].fen << endl;
+			failures++;
+			continue;
+		}
+
+		for (int d = 1; d <= depth; d++)
+		{
+			long long nodes = Perft(chess, d);
+			bool match = (nodes == suite[p].nodes[d - 1]);
+
+			cout << (match ? "ok     " : "FAILED ") << suite[p].name << " depth " << d << ": " << nodes;
+
+			if (!match)
+			{
+				cout << " (expected " << suite[p].nodes[d - 1] << ")";
+				failures++;
+			}
+
+			cout << endl;
+			total += nodes;
+		}
+	}
+
+	cout << endl;
+	Report(total, GetSeconds() - start);
+
+	if (failures)
+		cout << failures << " counts did not match" << endl;
+
+	return failures;
+}
+
+/****************************************************************************
+ * Name:        Usage
+ * Input:       None
+ * Output:      How to run the program
+ * Returns:     1, to be passed back as the exit code
+ * Description: Prints the command line options.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+static int Usage()
+{
+	cout << "usage: perft <depth> [fen]" << endl;
+	cout << "       perft divide <depth> [fen]" << endl;
+	cout << "       perft suite [depth]" << endl;
+
+	return 1;
+}
+
+/****************************************************************************
+ * Name:        main
+ * Input:       argc, argv - the command line
+ * Output:      The counts
+ * Returns:     0 on success, 1 on bad input or a failed count
+ * Description: Picks the mode from the command line and runs it.
+ * Invokes:     RunSuite()
+ *				Divide()
+ *				Perft()
+ *				Report()
+ * Note:        The FEN can be passed as one quoted argument or left unquoted,
+ *				the remaining arguments are joined back together.
+ ***************************************************************************/
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+		return Usage();
+
+	string mode = argv[1];
+
+	if (mode == "suite")
+		return RunSuite(argc > 2 ? atoi(argv[2]) : 0) ? 1 : 0;
+
+	bool divide = (mode == "divide");
+	int arg = (divide ? 2 : 1);
+
+	if (arg >= argc)
+		return Usage();
+
+	int depth = atoi(argv[arg++]);
+
+	if (depth < 1)
+		return Usage();
+
+	string fen;
+
+	for (; arg < argc; arg++)
+		fen += string(fen.empty() ? "" : " ") + argv[arg];
+
+	Chess chess;
+
+	if (!chess.LoadFEN(fen.empty() ? START_FEN : fen))
+	{
+		cout << "Bad FEN: " << fen << endl;
+		return 1;
+	}
+
+	double start = GetSeconds();
+	long long nodes = (divide ? Divide(chess, depth) : Perft(chess, depth));
+
+	Report(nodes, GetSeconds() - start);
+
+	return 0;
+}
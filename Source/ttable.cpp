@@ -0,0 +1,303 @@
+//===========================================================================
+//
+//  File name ......: ttable.cpp
+//  Author(s) ......: Team Girella (transposition table)
+//  Language .......: C++
+//  Started ........: October 17, 2026
+//  Last modified ..: October 17, 2026
+//  Version ........: 1.0
+//  Source Path ....: .
+//  Operating System: Linux, Windows
+//  Purpose ........: Implementation of the transposition table - sizing,
+//			the bucket replacement scheme, and packing each entry
+//			into one word so threads can share it without locks.
+//
+//===========================================================================
+
+#include <new>
+#include "ttable.h"
+
+/****************************************************************************
+ * Name:        TransTable
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Default constructor, the memory isn't taken until Resize().
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+TransTable::TransTable()
+{
+	buckets = 0;
+	mask = 0;
+	megabytes = 0;
+	age = 0;
+}
+
+/****************************************************************************
+ * Name:        ~TransTable
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Destructor, frees the table.
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+TransTable::~TransTable()
+{
+	delete [] buckets;
+}
+
+/****************************************************************************
+ * Name:        Resize
+ * Input:       megabytes - int
+ * Output:      None
+ * Returns:     None
+ * Description: Allocates the largest power of two number of buckets that
+ *				fits in the given size, and clears them.  The size is kept
+ *				between 1 and TT_MAX_MB, and if that much memory can't be
+ *				had the table makes do with less.
+ * Invokes:     Clear()
+ * Note:        Asking for the size the table already has only clears it.
+ *				Without even one bucket the table stays empty, and Probe()
+ *				and Store() do nothing.
+ ***************************************************************************/
+void TransTable::Resize(int mb)
+{
+	if (mb < 1)
+		mb = 1;
+
+	if (mb > TT_MAX_MB)
+		mb = TT_MAX_MB;
+
+	if (mb != megabytes || !buckets)
+	{
+		HashKey count = 1;
+
+		while (count * 2 * sizeof(Bucket) <= (HashKey)mb * 1024 * 1024)
+			count *= 2;
+
+		delete [] buckets;
+		buckets = 0;
+
+		// Halve the table until the memory is there
+		while (!buckets && count > 0)
+		{
+			buckets = new (std::nothrow) Bucket[count];
+
+			if (!buckets)
+				count /= 2;
+		}
+
+		mask = (buckets ? count - 1 : 0);
+		megabytes = mb;
+	}
+
+	Clear();
+}
+
+/****************************************************************************
+ * Name:        GetSize
+ * Input:       None
+ * Output:      None
+ * Returns:     the size of the table in megabytes, 0 if not allocated
+ * Description: Returns the size last passed to Resize().
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+int TransTable::GetSize()
+{
+	return (buckets ? megabytes : 0);
+}
+
+/****************************************************************************
+ * Name:        Clear
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Empties every entry in the table.
+ * Invokes:     None
+ * Note:        An empty entry has a depth of 0, which anything replaces.
+ *				Not to be called while a search is using the table.
+ ***************************************************************************/
+void TransTable::Clear()
+{
+	if (buckets)
+	{
+		for (HashKey b = 0; b <= mask; b++)
+		{
+			for (int i = 0; i < TT_BUCKET_SIZE; i++)
+			{
+				buckets[b].slots[i].key.store(0, std::memory_order_relaxed);
+				buckets[b].slots[i].data.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	age = 0;
+}
+
+/****************************************************************************
+ * Name:        NewSearch
+ * Input:       None
+ * Output:      None
+ * Returns:     None
+ * Description: Bumps the age, so entries from earlier searches are the first
+ *				to go when a bucket is full.
+ * Invokes:     None
+ * Note:        The age wraps around at 64.  Called between searches, never
+ *				during one.
+ ***************************************************************************/
+void TransTable::NewSearch()
+{
+	age = (age + 1) & 63;
+}
+
+/****************************************************************************
+ * Name:        Probe
+ * Input:       key - HashKey of the position
+ *				entry - filled in if the position is found
+ * Output:      None
+ * Returns:     true if the table has an entry for the position
+ * Description: Checks each entry in the position's bucket for its key.
+ * Invokes:     Pack()
+ *				Unpack()
+ * Note:        A hit refreshes the entry's age, since it is still useful.
+ ***************************************************************************/
+bool TransTable::Probe(HashKey key, TTEntry &entry)
+{
+	if (!buckets)
+		return false;
+
+	Slot *slots = buckets[key & mask].slots;
+
+	for (int i = 0; i < TT_BUCKET_SIZE; i++)
+	{
+		HashKey data = slots[i].data.load(std::memory_order_relaxed);
+
+		if ((slots[i].key.load(std::memory_order_relaxed) ^ data) == key && data)
+		{
+			entry = Unpack(data);
+
+			if ((entry.flags >> 2) != age)
+			{
+				entry.flags = (unsigned char)((entry.flags & 3) | (age << 2));
+				data = Pack(entry);
+
+				slots[i].data.store(data, std::memory_order_relaxed);
+				slots[i].key.store(key ^ data, std::memory_order_relaxed);
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/****************************************************************************
+ * Name:        Store
+ * Input:       key - HashKey of the position
+ *				depth - how deep the search below it went
+ *				bound - TT_EXACT, TT_LOWER or TT_UPPER
+ *				score - score the search found
+ *				move - best move found, Move() if none
+ * Output:      None
+ * Returns:     None
+ * Description: Saves the result over the position's old entry if it has
+ *				one, otherwise over the least valuable entry in its bucket -
+ *				the one with the smallest depth, counting each search it
+ *				has sat through as a few plies less.
+ * Invokes:     Pack()
+ *				Unpack()
+ * Note:        A new result without a move keeps the old entry's move, it's
+ *				still the best guess at what to try first.
+ ***************************************************************************/
+void TransTable::Store(HashKey key, int depth, int bound, int score, Move move)
+{
+	if (!buckets)
+		return;
+
+	Slot *slots = buckets[key & mask].slots;
+	Slot *replace = &slots[0];
+	int worst = 1 << 30;
+
+	for (int i = 0; i < TT_BUCKET_SIZE; i++)
+	{
+		HashKey data = slots[i].data.load(std::memory_order_relaxed);
+		TTEntry old = Unpack(data);
+
+		if ((slots[i].key.load(std::memory_order_relaxed) ^ data) == key)
+		{
+			replace = &slots[i];
+
+			if (move == Move())
+				move = old.move;
+
+			break;
+		}
+
+		int stale = (age - (old.flags >> 2)) & 63;
+		int value = old.depth - 4 * stale;
+
+		if (value < worst)
+		{
+			worst = value;
+			replace = &slots[i];
+		}
+	}
+
+	if (depth > 255)
+		depth = 255;
+
+	TTEntry entry;
+
+	entry.score = score;
+	entry.move = move;
+	entry.depth = (unsigned char)(depth < 1 ? 1 : depth);
+	entry.flags = (unsigned char)(bound | (age << 2));
+
+	HashKey data = Pack(entry);
+
+	replace->data.store(data, std::memory_order_relaxed);
+	replace->key.store(key ^ data, std::memory_order_relaxed);
+}
+
+/****************************************************************************
+ * Name:        Pack
+ * Input:       entry - an entry
+ * Output:      None
+ * Returns:     the entry as one 64 bit word
+ * Description: The score goes in the low 32 bits, then the move, the depth
+ *				and the flags.
+ * Invokes:     None
+ * Note:        A stored entry always has a depth, so its word is never 0.
+ ***************************************************************************/
+HashKey TransTable::Pack(const TTEntry &entry)
+{
+	return (HashKey)(unsigned int)entry.score |
+		   ((HashKey)entry.move.data << 32) |
+		   ((HashKey)entry.depth << 48) |
+		   ((HashKey)entry.flags << 56);
+}
+
+/****************************************************************************
+ * Name:        Unpack
+ * Input:       data - an entry packed by Pack()
+ * Output:      None
+ * Returns:     the entry
+ * Description: Undoes Pack().
+ * Invokes:     None
+ * Note:        None
+ ***************************************************************************/
+TTEntry TransTable::Unpack(HashKey data)
+{
+	TTEntry entry;
+
+	entry.score = (int)(unsigned int)(data & 0xFFFFFFFF);
+	entry.move.data = (unsigned short)(data >> 32);
+	entry.depth = (unsigned char)(data >> 48);
+	entry.flags = (unsigned char)(data >> 56);
+
+	return entry;
+}
@@ -0,0 +1,120 @@
+//===========================================================================
+//
+//  File name ......: ttable.h
+//  Author(s) ......: Team Girella (transposition table)
+//  Language .......: C++
+//  Started ........: October 17, 2026
+//  Last modified ..: October 17, 2026
+//  Version ........: 1.0
+//  Source Path ....: .
+//  Operating System: Linux, Windows
+//  Purpose ........: The transposition table - remembers what the search
+//			found out about each position so it doesn't have to be
+//			searched again when it comes up by another move order, or
+//			on the next move.  Several search threads can share one
+//			table without locking.
+//
+//===========================================================================
+
+#ifndef TTABLE_H
+#define TTABLE_H
+
+#include <atomic>
+
+#include "chess.h"
+
+// What a stored score says about the position's real value
+#define TT_EXACT		0	// the score is the value
+#define TT_LOWER		1	// the value is at least the score (it failed high)
+#define TT_UPPER		2	// the value is at most the score (it failed low)
+
+// Entries that share a slot of the table, one of which gets replaced
+#define TT_BUCKET_SIZE	4
+
+// Size used when a bot doesn't ask for one, and the most it can ask for,
+// in megabytes
+#define TT_DEFAULT_MB	16
+#define TT_MAX_MB		4096
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Name:        TTEntry
+// Description: What is known about one position, as handed out by Probe().
+//		In the table it is packed into 64 bits (see TransTable).
+/////////////////////////////////////////////////////////////////////////////
+struct TTEntry
+{
+	int score;				// score found by the search
+	Move move;				// best move found, or none
+	unsigned char depth;	// how deep the search below the position went
+	unsigned char flags;	// bound type in the low 2 bits, search age above
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Name:        TransTable
+// Description: A fixed size, power of two table of buckets, indexed by
+//		the position hash.  When a bucket is full the entry replaced is
+//		the one from the oldest search with the least depth behind it.
+//		Each entry is two 64 bit words - the packed data, and the hash
+//		XORed with the data.  Threads read and write the words without
+//		locks, so one thread may see half of another's write, but then
+//		the key doesn't check out and it is just a miss.
+/////////////////////////////////////////////////////////////////////////////
+class TransTable
+{
+	public:
+
+		// Constructor - the table starts out empty, with no memory
+		TransTable();
+
+		// Destructor - frees the table
+		~TransTable();
+
+		// Sets the size of the table in megabytes, clearing it
+		void Resize(int megabytes);
+
+		// Returns the size of the table in megabytes
+		int GetSize();
+
+		// Forgets everything in the table
+		void Clear();
+
+		// Marks the start of a new search, so old entries give way first
+		void NewSearch();
+
+		// Looks up a position, returns true and fills in entry if found
+		bool Probe(HashKey key, TTEntry &entry);
+
+		// Saves what the search found out about a position
+		void Store(HashKey key, int depth, int bound, int score, Move move);
+
+	protected:
+
+		// Stops the table being copied (it owns its memory)
+		TransTable(const TransTable &);
+		TransTable &operator = (const TransTable &);
+
+		// 16 bytes, four to a bucket
+		struct Slot
+		{
+			std::atomic<HashKey> key;	// the position's hash XOR data
+			std::atomic<HashKey> data;	// score, move, depth and flags
+		};
+
+		struct Bucket
+		{
+			Slot slots[TT_BUCKET_SIZE];
+		};
+
+		// Packs and unpacks the data word
+		static HashKey Pack(const TTEntry &entry);
+		static TTEntry Unpack(HashKey data);
+
+		Bucket *buckets;	// the table itself
+		HashKey mask;		// number of buckets - 1, for picking one
+		int megabytes;		// size asked for
+		int age;			// counts searches, kept to 6 bits
+};
+
+#endif